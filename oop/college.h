@@ -1,10 +1,21 @@
 #ifndef COLLEGE_H
 #define COLLEGE_H
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
-#include <regex>
+#include <ranges>
 #include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 class Course;
 class Person;
@@ -31,31 +42,275 @@ concept same_as_any = (std::same_as<T, Ts> || ...);
 template <typename T>
 concept dereferenceable = requires(T a) { *a; };
 
+// Courses are ordered by name and persons by surname, then name. These are
+// the keys of that order, by which they can be looked up.
+using person_key = std::pair<std::string_view, std::string_view>;
+
+std::string_view sort_key(Course const &course) noexcept;
+person_key sort_key(Person const &person) noexcept;
+
+template <typename T>
+concept sort_key_type = same_as_any<T, std::string_view, person_key>;
+
+// A weak pointer to a person which also keeps the raw pointer, so that the
+// person can be reached without locking it as long as it has not expired,
+// and a copy of its sort key, which outlives the person.
+template <typename T>
+struct weak_entry {
+    weak_entry(std::shared_ptr<T> const &shared)
+        : pointer(shared), raw(shared.get()),
+          key(shared->get_surname(), shared->get_name()) {}
+
+    person_key sort_key() const noexcept {
+        return {key.first, key.second};
+    }
+
+    std::weak_ptr<T> pointer;
+    T *raw;
+    std::pair<std::string, std::string> key;
+};
+
+// Compares what pointers point to, with each other or with sort keys.
+// Weak pointers are compared by the keys they keep, so comparing them does
+// not lock them.
 struct deref_compare {
+    using is_transparent = void;
+
     template <typename T>
-    bool
-    operator()(std::weak_ptr<T> const &lhs, std::weak_ptr<T> const &rhs) const {
-        auto locked_lhs = lhs.lock();
-        auto locked_rhs = rhs.lock();
+    bool operator()(weak_entry<T> const &lhs, weak_entry<T> const &rhs) const {
+        return lhs.key < rhs.key;
+    }
 
-        if (!locked_lhs || !locked_rhs) {
-            return !locked_lhs && locked_rhs;
-        }
+    template <typename T>
+    bool operator()(weak_entry<T> const &lhs, person_key rhs) const {
+        return lhs.sort_key() < rhs;
+    }
 
-        return *locked_lhs < *locked_rhs;
+    template <typename T>
+    bool operator()(person_key lhs, weak_entry<T> const &rhs) const {
+        return lhs < rhs.sort_key();
     }
 
-    template <dereferenceable T>
-    bool operator()(T const &lhs, T const &rhs) const {
+    template <dereferenceable T, dereferenceable U>
+    bool operator()(T const &lhs, U const &rhs) const {
         return *lhs < *rhs;
     }
+
+    template <dereferenceable T, sort_key_type Key>
+    bool operator()(T const &lhs, Key rhs) const {
+        return sort_key(*lhs) < rhs;
+    }
+
+    template <sort_key_type Key, dereferenceable T>
+    bool operator()(Key lhs, T const &rhs) const {
+        return lhs < sort_key(*rhs);
+    }
 };
 
 template <typename T>
 using set_of_shp = std::set<std::shared_ptr<T>, deref_compare>;
 
 template <typename T>
-using set_of_wkp = std::set<std::weak_ptr<T>, deref_compare>;
+using set_of_wkp = std::set<weak_entry<T>, deref_compare>;
+
+// Sorted view of the participants of a course which are still alive,
+// skipping the expired ones as it goes. It allocates nothing and touches
+// no reference counts; a participant stays valid as long as someone, such
+// as its college, owns it.
+template <typename T>
+class participant_view
+    : public std::ranges::view_interface<participant_view<T>> {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+
+        iterator() = default;
+
+        T &operator*() const noexcept {
+            return *position->raw;
+        }
+
+        T *operator->() const noexcept {
+            return position->raw;
+        }
+
+        iterator &operator++() noexcept {
+            ++position;
+            skip_expired();
+            return *this;
+        }
+
+        iterator operator++(int) noexcept {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(iterator const &other) const noexcept {
+            return position == other.position;
+        }
+
+    private:
+        friend participant_view;
+
+        using set_iterator = typename set_of_wkp<T>::const_iterator;
+
+        set_iterator position;
+        set_iterator end;
+
+        iterator(set_iterator position, set_iterator end) noexcept
+            : position(position), end(end) {
+            skip_expired();
+        }
+
+        void skip_expired() noexcept {
+            while (position != end && position->pointer.expired()) {
+                ++position;
+            }
+        }
+    };
+
+    participant_view() = default;
+
+    explicit participant_view(set_of_wkp<T> const &participants) noexcept
+        : participants(&participants) {}
+
+    iterator begin() const noexcept {
+        if (!participants) {
+            return {};
+        }
+
+        return {participants->begin(), participants->end()};
+    }
+
+    iterator end() const noexcept {
+        if (!participants) {
+            return {};
+        }
+
+        return {participants->end(), participants->end()};
+    }
+
+private:
+    set_of_wkp<T> const *participants = nullptr;
+};
+
+// A wildcard pattern, in which '?' matches any single character and '*'
+// any sequence of characters, compiled once into the segments between the
+// stars. Matching places every segment at its leftmost possible position,
+// which never needs backtracking, so it takes at most
+// O(text length * pattern length) and usually linear time.
+class glob {
+public:
+    explicit glob(std::string_view pattern) {
+        size_t star = pattern.find('*');
+
+        starred = star != std::string_view::npos;
+
+        while (star != std::string_view::npos) {
+            segments.emplace_back(pattern.substr(0, star));
+            pattern.remove_prefix(star + 1);
+            star = pattern.find('*');
+        }
+
+        segments.emplace_back(pattern);
+    }
+
+    // The literal beginning of the pattern, which every match starts with.
+    std::string_view prefix() const noexcept {
+        std::string_view first = segments.front();
+        return first.substr(0, first.find('?'));
+    }
+
+    // The literal parts of the pattern, which every match contains.
+    std::vector<std::string_view> fragments() const {
+        std::vector<std::string_view> result;
+
+        for (std::string_view segment : segments) {
+            size_t mark = segment.find('?');
+
+            while (mark != std::string_view::npos) {
+                result.push_back(segment.substr(0, mark));
+                segment.remove_prefix(mark + 1);
+                mark = segment.find('?');
+            }
+
+            result.push_back(segment);
+        }
+
+        return result;
+    }
+
+    bool matches(std::string_view text) const noexcept {
+        std::string const &first = segments.front();
+        std::string const &last = segments.back();
+
+        if (!starred) {
+            return text.size() == first.size() && matches_at(text, 0, first);
+        }
+
+        if (text.size() < first.size() + last.size() ||
+            !matches_at(text, 0, first) ||
+            !matches_at(text, text.size() - last.size(), last)) {
+            return false;
+        }
+
+        size_t position = first.size();
+        size_t end = text.size() - last.size();
+
+        for (size_t i = 1; i + 1 < segments.size(); i++) {
+            std::string const &segment = segments[i];
+
+            while (position + segment.size() <= end &&
+                   !matches_at(text, position, segment)) {
+                position++;
+            }
+
+            if (position + segment.size() > end) {
+                return false;
+            }
+
+            position += segment.size();
+        }
+
+        return true;
+    }
+
+private:
+    std::vector<std::string> segments;
+    bool starred;
+
+    static bool matches_at(std::string_view text, size_t position,
+                           std::string_view segment) noexcept {
+        for (size_t i = 0; i < segment.size(); i++) {
+            if (segment[i] != '?' && segment[i] != text[position + i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+// Calls visit for every three consecutive characters of text, packed into
+// a number.
+template <typename Visit>
+void for_each_trigram(std::string_view text, Visit visit) {
+    for (size_t i = 0; i + 3 <= text.size(); i++) {
+        visit(uint32_t(uint8_t(text[i])) << 16 |
+              uint32_t(uint8_t(text[i + 1])) << 8 |
+              uint32_t(uint8_t(text[i + 2])));
+    }
+}
+
+// Inverted index from the trigrams of names to what has them in its name.
+template <typename T>
+using trigram_index = std::unordered_map<uint32_t, set_of_shp<T>>;
 
 }  // namespace col_detail
 
@@ -91,20 +346,22 @@ public:
         }
 
         auto &set_of_T = std::get<col_detail::set_of_wkp<T>>(participants);
-        auto it = set_of_T.find(person);
+        auto it = set_of_T.find(col_detail::sort_key(*person));
 
-        if (it != set_of_T.end()) {
-            auto locked_it = it->lock();
-
-            if (locked_it && locked_it == person) {
-                return false;
-            }
+        if (it != set_of_T.end() && it->raw == person.get() &&
+            !it->pointer.expired()) {
+            return false;
         }
 
         if (!active) {
             throw std::logic_error("Incorrect operation for an inactive course.");
         }
 
+        // a participant of the same name that is gone makes room
+        if (it != set_of_T.end() && it->pointer.expired()) {
+            set_of_T.erase(it);
+        }
+
         return set_of_T.insert(person).second;
     }
 
@@ -114,7 +371,7 @@ public:
         col_detail::set_of_shp<T> res_participants;
 
         for (auto const &participant : set_of_T) {
-            auto locked_participant = participant.lock();
+            auto locked_participant = participant.pointer.lock();
 
             if (locked_participant) {
                 res_participants.insert(locked_participant);
@@ -124,6 +381,13 @@ public:
         return res_participants;
     }
 
+    // Like get_participants, but without copying them.
+    template <col_detail::same_as_any<Student, Teacher> T>
+    col_detail::participant_view<T> view_participants() const noexcept {
+        return col_detail::participant_view<T>(
+            std::get<col_detail::set_of_wkp<T>>(participants));
+    }
+
 private:
     std::string name;
     bool active;
@@ -167,6 +431,14 @@ private:
 
 namespace col_detail {
 
+inline std::string_view sort_key(Course const &course) noexcept {
+    return course.get_name();
+}
+
+inline person_key sort_key(Person const &person) noexcept {
+    return {person.get_surname(), person.get_name()};
+}
+
 // A set wrapper for courses which a person has.
 class Academic : public virtual Person {
 protected:
@@ -255,24 +527,61 @@ public:
 
 class College {
 public:
+    // With trigram_index, the college keeps an index of the trigrams of
+    // course names, person names and surnames, so that patterns with no
+    // literal prefix, such as "*matem*", do not scan everything.
+    explicit College(bool trigram_index = false) : indexed(trigram_index) {}
+
     bool add_course(std::string_view name, bool active = true) {
-        return courses.insert(std::make_shared<Course>(name, active)).second;
+        auto [it, inserted] =
+            courses.insert(std::make_shared<Course>(name, active));
+
+        if (inserted && indexed) {
+            add_to_index(course_trigrams, *it, name);
+        }
+
+        return inserted;
     }
 
     col_detail::set_of_shp<Course> const
     find_courses(std::string_view pattern) const {
         col_detail::set_of_shp<Course> found_courses;
-        std::regex regex_pattern(wildcard_to_regex(pattern));
+        col_detail::glob name_glob(pattern);
+        std::string_view prefix = name_glob.prefix();
+        postings<Course> candidates;
+
+        if (prefix.empty()) {
+            find_postings(course_trigrams, name_glob, candidates);
+        }
+
+        if (!candidates.empty()) {
+            for_each_candidate(candidates, [&](auto const &course) {
+                if (name_glob.matches(course->get_name())) {
+                    found_courses.insert(found_courses.end(), course);
+                }
+            });
+
+            return found_courses;
+        }
 
-        for (auto const &course : courses) {
-            if (std::regex_match(course->get_name(), regex_pattern)) {
-                found_courses.insert(course);
+        // only the names starting with the prefix of the pattern can match
+        for (auto it = courses.lower_bound(prefix);
+             it != courses.end() && (*it)->get_name().starts_with(prefix);
+             ++it) {
+            if (name_glob.matches((*it)->get_name())) {
+                found_courses.insert(*it);
             }
         }
 
         return found_courses;
     }
 
+    // The course with the given name, or nullptr.
+    std::shared_ptr<Course> course(std::string_view name) const {
+        auto it = courses.find(name);
+        return it == courses.end() ? nullptr : *it;
+    }
+
     bool change_course_activeness(std::shared_ptr<Course> const &course,
                                   bool active) const noexcept {
         if (!course) {
@@ -301,20 +610,51 @@ public:
         }
 
         course->set_active(false);
+
+        if (indexed) {
+            remove_from_index(course_trigrams, course, course->get_name());
+        }
+
         return courses.erase(course);
     }
 
     template <col_detail::same_as_any<Student, Teacher, PhDStudent> T>
     bool add_person(std::string_view name, std::string_view surname,
                     bool active = true) {
+        std::shared_ptr<T> person;
+
         if constexpr (std::is_same_v<T, Teacher>) {
-            return participants.insert(std::make_shared<T>(name, surname))
-                .second;
+            person = std::make_shared<T>(name, surname);
         } else {
-            return participants
-                .insert(std::make_shared<T>(name, surname, active))
-                .second;
+            person = std::make_shared<T>(name, surname, active);
+        }
+
+        if (!participants.insert(person).second) {
+            return false;
         }
+
+        // a PhD student is in the views of students and teachers too
+        if constexpr (std::is_base_of_v<Student, T>) {
+            std::get<col_detail::set_of_shp<Student>>(participants_by_type)
+                .insert(person);
+        }
+
+        if constexpr (std::is_base_of_v<Teacher, T>) {
+            std::get<col_detail::set_of_shp<Teacher>>(participants_by_type)
+                .insert(person);
+        }
+
+        if constexpr (std::is_same_v<T, PhDStudent>) {
+            std::get<col_detail::set_of_shp<PhDStudent>>(participants_by_type)
+                .insert(person);
+        }
+
+        if (indexed) {
+            add_to_index(name_trigrams, person, name);
+            add_to_index(surname_trigrams, person, surname);
+        }
+
+        return true;
     }
 
     bool change_student_activeness(std::shared_ptr<Student> const &student,
@@ -337,26 +677,66 @@ public:
     col_detail::set_of_shp<T> const find(std::string_view name_pattern,
                                          std::string_view surname_pattern) const {
         col_detail::set_of_shp<T> found_persons;
+        col_detail::set_of_shp<T> const &persons = participants_of<T>();
+        col_detail::glob name_glob(name_pattern);
+        col_detail::glob surname_glob(surname_pattern);
+        std::string_view prefix = surname_glob.prefix();
+        postings<Person> candidates;
+
+        auto matches = [&](auto const &person) {
+            return name_glob.matches(person->get_name()) &&
+                   surname_glob.matches(person->get_surname());
+        };
+
+        if (prefix.empty()) {
+            find_postings(name_trigrams, name_glob, candidates);
+            find_postings(surname_trigrams, surname_glob, candidates);
+        }
 
-        for (auto const &person : participants) {
-            auto cast_person = std::dynamic_pointer_cast<T>(person);
+        if (!candidates.empty()) {
+            for_each_candidate(candidates, [&](auto const &person) {
+                if (!matches(person)) {
+                    return;
+                }
 
-            if (cast_person) {
-                std::regex rx_name(wildcard_to_regex(name_pattern));
-                std::regex rx_surname(wildcard_to_regex(surname_pattern));
+                if constexpr (std::is_same_v<T, Person>) {
+                    found_persons.insert(found_persons.end(), person);
+                } else {
+                    // the view of type T has the person if it is a T
+                    auto it = persons.find(col_detail::sort_key(*person));
 
-                if (std::regex_match(cast_person->get_name(), rx_name)
-                    && std::regex_match(
-                        cast_person->get_surname(), rx_surname
-                    )) {
-                    found_persons.insert(cast_person);
+                    if (it != persons.end()) {
+                        found_persons.insert(found_persons.end(), *it);
+                    }
                 }
+            });
+
+            return found_persons;
+        }
+
+        // persons are sorted by surname first, so only the surnames
+        // starting with the prefix of the pattern can match
+        for (auto it = persons.lower_bound(col_detail::person_key(prefix, ""));
+             it != persons.end() && (*it)->get_surname().starts_with(prefix);
+             ++it) {
+            if (matches(*it)) {
+                found_persons.insert(found_persons.end(), *it);
             }
         }
 
         return found_persons;
     }
 
+    // The person with the given surname and name if it is a T, or nullptr.
+    template <col_detail::same_as_any<Person, Student, Teacher, PhDStudent> T =
+                  Person>
+    std::shared_ptr<T> person(std::string_view surname,
+                              std::string_view name) const {
+        col_detail::set_of_shp<T> const &persons = participants_of<T>();
+        auto it = persons.find(col_detail::person_key(surname, name));
+        return it == persons.end() ? nullptr : *it;
+    }
+
     template <col_detail::same_as_any<Student, Teacher> T>
     col_detail::set_of_shp<T> const find(std::shared_ptr<Course> const &course) const {
         if (!course) {
@@ -372,6 +752,23 @@ public:
         return (*it)->get_participants<T>();
     }
 
+    // Like find(course), but without copying the participants.
+    template <col_detail::same_as_any<Student, Teacher> T>
+    col_detail::participant_view<T>
+    view(std::shared_ptr<Course> const &course) const noexcept {
+        if (!course) {
+            return {};
+        }
+
+        auto it = courses.find(course);
+
+        if (it == courses.end() || *it != course) {
+            return {};
+        }
+
+        return (*it)->view_participants<T>();
+    }
+
     template <col_detail::same_as_any<Student, Teacher> T>
     bool assign_course(std::shared_ptr<T> const &person,
                        std::shared_ptr<Course> const &course) const {
@@ -404,41 +801,90 @@ public:
     }
 
 private:
+    template <typename T>
+    using postings = std::vector<col_detail::set_of_shp<T> const *>;
+
     col_detail::set_of_shp<Course> courses;
     col_detail::set_of_shp<Person> participants;
+    // views of participants by type, so that find<T> needs no casts
+    std::tuple<col_detail::set_of_shp<Student>, col_detail::set_of_shp<Teacher>,
+               col_detail::set_of_shp<PhDStudent>>
+        participants_by_type;
+    bool indexed;
+    col_detail::trigram_index<Course> course_trigrams;
+    col_detail::trigram_index<Person> name_trigrams;
+    col_detail::trigram_index<Person> surname_trigrams;
+
+    template <typename T>
+    col_detail::set_of_shp<T> const &participants_of() const noexcept {
+        if constexpr (std::is_same_v<T, Person>) {
+            return participants;
+        } else {
+            return std::get<col_detail::set_of_shp<T>>(participants_by_type);
+        }
+    }
+
+    template <typename T>
+    static void add_to_index(col_detail::trigram_index<T> &index,
+                             std::type_identity_t<std::shared_ptr<T>> entry,
+                             std::string_view name) {
+        col_detail::for_each_trigram(name, [&](uint32_t trigram) {
+            index[trigram].insert(entry);
+        });
+    }
 
-    static std::string wildcard_to_regex(std::string_view pattern) {
-        std::string regex_pattern;
-
-        for (char c : pattern) {
-            switch (c) {
-            case '*':
-                regex_pattern += ".*";
-                break;
-            case '?':
-                regex_pattern += '.';
-                break;
-            case '.':
-            case '+':
-            case '\\':
-            case '(':
-            case ')':
-            case '[':
-            case ']':
-            case '{':
-            case '}':
-            case '^':
-            case '$':
-            case '|':
-                regex_pattern += '\\';
-                regex_pattern += c;
-                break;
-            default:
-                regex_pattern += c;
+    template <typename T>
+    static void remove_from_index(col_detail::trigram_index<T> &index,
+                                  std::shared_ptr<T> const &entry,
+                                  std::string_view name) noexcept {
+        col_detail::for_each_trigram(name, [&](uint32_t trigram) {
+            auto it = index.find(trigram);
+
+            if (it != index.end() && it->second.erase(entry) &&
+                it->second.empty()) {
+                index.erase(it);
             }
+        });
+    }
+
+    // Adds to found the posting lists of the trigrams in the literal
+    // fragments of pattern, an empty one for a trigram nothing has. Adds
+    // nothing when the index is off or the pattern has no trigrams.
+    template <typename T>
+    void find_postings(col_detail::trigram_index<T> const &index,
+                       col_detail::glob const &pattern,
+                       postings<T> &found) const {
+        static col_detail::set_of_shp<T> const nothing;
+
+        if (!indexed) {
+            return;
         }
 
-        return regex_pattern;
+        for (std::string_view fragment : pattern.fragments()) {
+            col_detail::for_each_trigram(fragment, [&](uint32_t trigram) {
+                auto it = index.find(trigram);
+                found.push_back(it == index.end() ? &nothing : &it->second);
+            });
+        }
+    }
+
+    // Calls visit, in order, for the entries found in all the lists.
+    template <typename T, typename Visit>
+    static void for_each_candidate(postings<T> const &lists, Visit visit) {
+        auto shortest = std::min_element(
+            lists.begin(), lists.end(),
+            [](auto const *lhs, auto const *rhs) {
+                return lhs->size() < rhs->size();
+            });
+
+        for (auto const &entry : **shortest) {
+            if (std::all_of(lists.begin(), lists.end(),
+                            [&](auto const *list) {
+                                return list->contains(entry);
+                            })) {
+                visit(entry);
+            }
+        }
     }
 
     bool person_exists(std::shared_ptr<Person> const &person) const noexcept {
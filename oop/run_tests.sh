@@ -20,7 +20,7 @@ run_test() {
   fi
 }
 
-for i in {101..104} {201..201} {301..301} {401..401} {501..502} {601..602}; do
+for i in {101..104} {201..201} {301..301} {401..401} {501..502} {601..602} {701..703}; do
   g++ -Wall -Wextra -std=c++20 -DTEST_NUM="$i" college_test.cc -o tescik
   run_test "$i";
 done
@@ -854,6 +854,241 @@ void test_602() { // Testing performance
 }
 #endif // TEST_NUM == 602
 
+#if TEST_NUM == 701
+// Names of what find or find_courses returned, which differ between
+// colleges only in the pointers.
+template <typename T>
+std::vector<std::string> names_of(
+    std::set<std::shared_ptr<T>, col_detail::deref_compare> const &found) {
+  std::vector<std::string> names;
+  for (auto const &it : found) {
+    if constexpr (std::is_same_v<T, Course>) {
+      names.push_back(it->get_name());
+    } else {
+      names.push_back(it->get_surname() + "/" + it->get_name());
+    }
+  }
+  return names;
+}
+
+std::string random_text(char const *letters, int letter_count, int max_length) {
+  std::string text;
+  for (int length = rand() % (max_length + 1); length > 0; length--) {
+    text += letters[rand() % letter_count];
+  }
+  return text;
+}
+
+void test_701() { // The trigram index does not change any result.
+  College college, indexed(true);
+  srand(0);
+  for (int i = 0; i < 400; i++) {
+    std::string name = random_text("abcd", 4, 7);
+    std::string surname = random_text("abcd", 4, 7);
+    std::string course = random_text("abcd", 4, 7);
+    switch (i % 3) {
+      case 0:
+        assert(college.add_person<Student>(name, surname) ==
+               indexed.add_person<Student>(name, surname));
+        break;
+      case 1:
+        assert(college.add_person<Teacher>(name, surname) ==
+               indexed.add_person<Teacher>(name, surname));
+        break;
+      default:
+        assert(college.add_person<PhDStudent>(name, surname) ==
+               indexed.add_person<PhDStudent>(name, surname));
+    }
+    assert(college.add_course(course) == indexed.add_course(course));
+  }
+
+  auto compare = [&](int queries) {
+    for (int i = 0; i < queries; i++) {
+      // mostly patterns without a prefix, which the index answers
+      std::string name = (rand() % 4 ? "*" : "") + random_text("abcd?*", 6, 6);
+      std::string surname = (rand() % 4 ? "*" : "") + random_text("abcd?*", 6, 6);
+      assert(names_of(college.find<Person>(name, surname)) ==
+             names_of(indexed.find<Person>(name, surname)));
+      assert(names_of(college.find<Student>(name, surname)) ==
+             names_of(indexed.find<Student>(name, surname)));
+      assert(names_of(college.find<Teacher>(name, surname)) ==
+             names_of(indexed.find<Teacher>(name, surname)));
+      assert(names_of(college.find<PhDStudent>(name, surname)) ==
+             names_of(indexed.find<PhDStudent>(name, surname)));
+      assert(names_of(college.find_courses(name)) ==
+             names_of(indexed.find_courses(name)));
+    }
+  };
+
+  compare(500);
+  assert(names_of(indexed.find_courses("*abc*")).size() > 0);
+
+  // removed courses must leave the index too
+  for (int i = 0; i < 100; i++) {
+    std::string pattern = "*" + random_text("abcd", 4, 3) + "*";
+    auto found = college.find_courses(pattern);
+    auto found_indexed = indexed.find_courses(pattern);
+    assert(names_of(found) == names_of(found_indexed));
+    if (!found.empty()) {
+      assert(college.remove_course(*found.begin()));
+      assert(indexed.remove_course(*found_indexed.begin()));
+      assert(indexed.find_courses((*found_indexed.begin())->get_name()).empty());
+    }
+  }
+
+  compare(500);
+
+  // and come back when added again
+  assert(indexed.add_course("xabcdx") && college.add_course("xabcdx"));
+  assert(names_of(indexed.find_courses("*bcd*")) ==
+         names_of(college.find_courses("*bcd*")));
+  assert(indexed.find_courses("*bcd*").size() > 0);
+}
+#endif // TEST_NUM == 701
+
+#if TEST_NUM == 702
+void test_702() { // Views of the participants of a course.
+  College college, college2;
+  assert(college.add_course("C++"));
+  assert(college2.add_course("C++"));
+  auto cxx = college.course("C++");
+  auto cxx2 = college2.course("C++");
+
+  for (auto surname : {"Nowak", "Kowalski", "Zielinski"}) {
+    assert(college.add_person<Student>("Jan", surname));
+  }
+  assert(college.add_person<Student>("Adam", "Nowak"));
+  assert(college.add_person<PhDStudent>("Ewa", "Lis"));
+  for (auto const &student : college.find<Student>("*", "*")) {
+    assert(college.assign_course(student, cxx));
+  }
+  auto ewa = college.person<PhDStudent>("Lis", "Ewa");
+  assert(college.assign_course<Teacher>(ewa, cxx));
+
+  // sorted by surname, then by name, like the sets returned by find
+  std::vector<std::string> names;
+  for (Student const &student : college.view<Student>(cxx)) {
+    names.push_back(student.get_surname() + "/" + student.get_name());
+  }
+  assert((names == std::vector<std::string>{"Kowalski/Jan", "Lis/Ewa",
+                                            "Nowak/Adam", "Nowak/Jan",
+                                            "Zielinski/Jan"}));
+  auto found = college.find<Student>(cxx);
+  assert(std::ranges::equal(college.view<Student>(cxx), found, {},
+                            [](Student const &s) { return &s; },
+                            [](auto const &s) { return s.get(); }));
+  assert(std::ranges::distance(college.view<Teacher>(cxx)) == 1);
+  assert(&college.view<Teacher>(cxx).front() == ewa.get());
+  assert(&*cxx->view_participants<Student>().begin() ==
+         college.person<Student>("Kowalski", "Jan").get());
+
+  // participants that are gone are skipped, wherever they are
+  auto first = std::make_shared<Student>("A", "A");
+  auto middle = std::make_shared<Student>("A", "M");
+  auto middle2 = std::make_shared<Student>("B", "M");
+  auto last = std::make_shared<Student>("Z", "Z");
+  for (auto const &student : {first, middle, middle2, last}) {
+    assert(cxx->add_participant(student));
+  }
+  assert(std::ranges::distance(college.view<Student>(cxx)) == 9);
+  first.reset();
+  middle.reset();
+  middle2.reset();
+  last.reset();
+  assert(std::ranges::distance(college.view<Student>(cxx)) == 5);
+  assert(college.view<Student>(cxx).front().get_surname() == "Kowalski");
+  for (Student const &student : college.view<Student>(cxx)) {
+    assert(student.get_name() != "A" && student.get_name() != "Z");
+  }
+
+  auto gone = std::make_shared<Teacher>("T", "T");
+  assert(cxx->add_participant(gone));
+  gone.reset();
+  assert(std::ranges::distance(college.view<Teacher>(cxx)) == 1);
+
+  // no course, a course of another college, a removed course
+  assert(college.view<Student>(nullptr).empty());
+  assert(college.view<Teacher>(nullptr).begin() ==
+         college.view<Teacher>(nullptr).end());
+  assert(college.view<Student>(cxx2).empty());
+  assert(college2.view<Student>(cxx).empty());
+  assert(col_detail::participant_view<Student>().empty());
+  assert(college.remove_course(cxx));
+  assert(college.view<Student>(cxx).empty());
+  assert(std::ranges::distance(cxx->view_participants<Student>()) == 5);
+}
+#endif // TEST_NUM == 702
+
+#if TEST_NUM == 703
+void test_703() { // Lookups by name and replacing participants that are gone.
+  College college;
+  assert(college.add_course("Algebra"));
+  assert(college.add_course("Algebra 2"));
+  assert(college.add_person<PhDStudent>("Jan", "Kowalski"));
+  assert(college.add_person<Teacher>("Ewa", "Nowak"));
+  assert(college.add_person<Student>("Adam", "Nowak"));
+
+  auto algebra = college.course("Algebra");
+  assert(algebra && algebra->get_name() == "Algebra");
+  assert(algebra == *college.find_courses("Algebra").begin());
+  assert(!college.course("Alg") && !college.course("Alg*") &&
+         !college.course("Algebra ") && !college.course(""));
+  assert(college.course("Algebra 2") != algebra);
+  assert(college.remove_course(algebra));
+  assert(!college.course("Algebra"));
+  assert(college.add_course("Algebra"));
+  assert(college.course("Algebra") && college.course("Algebra") != algebra);
+
+  // surname first; a person of another type is not found
+  auto jan = college.person("Kowalski", "Jan");
+  assert(jan && jan->get_name() == "Jan" && jan->get_surname() == "Kowalski");
+  auto jan_phd = college.person<PhDStudent>("Kowalski", "Jan");
+  assert(college.person<Student>("Kowalski", "Jan") == jan_phd);
+  assert(college.person<Teacher>("Kowalski", "Jan"));
+  assert(!college.person("Jan", "Kowalski"));
+  assert(college.person<Teacher>("Nowak", "Ewa"));
+  assert(!college.person<Student>("Nowak", "Ewa"));
+  assert(!college.person<PhDStudent>("Nowak", "Ewa"));
+  assert(college.person<Student>("Nowak", "Adam"));
+  assert(!college.person<Teacher>("Nowak", "Adam"));
+  assert(!college.person("Nowak", "*") && !college.person("N*", "Adam"));
+  assert(college.person("Nowak", "Adam") ==
+         *college.find<Person>("Adam", "Nowak").begin());
+
+  // a participant is refused while a namesake is alive, but replaces one
+  // that is gone
+  auto course = college.course("Algebra 2");
+  auto adam = college.person<Student>("Nowak", "Adam");
+  assert(!course->add_participant(std::shared_ptr<Student>()));
+  assert(course->add_participant(adam));
+  assert(!course->add_participant(adam));
+  assert(!course->add_participant(std::make_shared<Student>("Adam", "Nowak")));
+  assert(&college.view<Student>(course).front() == adam.get());
+
+  auto ghost = std::make_shared<Teacher>("Duch", "Kacper");
+  assert(course->add_participant(ghost));
+  ghost.reset();
+  auto replacement = std::make_shared<Teacher>("Duch", "Kacper");
+  assert(course->add_participant(replacement));
+  assert(!course->add_participant(replacement));
+  assert(course->get_participants<Teacher>().size() == 1);
+  assert(&college.view<Teacher>(course).front() == replacement.get());
+
+  // an inactive course takes nobody, not even in place of someone gone
+  replacement.reset();
+  assert(college.change_course_activeness(course, false));
+  assert(!course->add_participant(adam));
+  bool thrown = false;
+  try {
+    course->add_participant(std::make_shared<Teacher>("Duch", "Kacper"));
+  } catch (std::logic_error const &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(college.view<Teacher>(course).empty());
+}
+#endif // TEST_NUM == 703
+
 } // koniec anonimowej przestrzeni nazw
 
 int main() {
@@ -903,5 +1138,11 @@ int main() {
   test_601();
 #elif TEST_NUM == 602
   test_602();
+#elif TEST_NUM == 701
+  test_701();
+#elif TEST_NUM == 702
+  test_702();
+#elif TEST_NUM == 703
+  test_703();
 #endif
 }
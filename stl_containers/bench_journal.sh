@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Throughput of acknowledged purchases with the durable journal, for
+# different --journal-batch sizes, and how many records a sync took on
+# average. Once a sync takes longer than the input needs to fill a batch,
+# the records per sync no longer follow the batch size.
+#
+# usage: ./bench_journal.sh [PURCHASES] [BATCH SIZES...]
+
+make -s parking
+
+PURCHASES=${1:-20000}
+BATCHES=(1 8 64 512)
+
+if [[ $# -gt 1 ]]; then
+    BATCHES=("${@:2}")
+fi
+
+# put the journal next to the verifier, tmpfs would not sync anything
+JOURNAL=$(mktemp ./bench_journal.XXXXXX)
+INPUT=$(mktemp)
+trap 'rm -f "$JOURNAL" "$INPUT"' EXIT
+
+awk -v n="$PURCHASES" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf "P%08d 8.%02d 9.%02d\n", i, i % 50, i % 50
+}' > "$INPUT"
+
+for batch in "${BATCHES[@]}"; do
+    rm -f "$JOURNAL"
+    start=$(date +%s%N)
+    perSync=$(./parking --journal "$JOURNAL" --durable --journal-batch "$batch" \
+        --stats < "$INPUT" 2>&1 > /dev/null |
+        awk '/^journal records per sync/ { print $5 }')
+    end=$(date +%s%N)
+
+    echo "batch $batch: $(( PURCHASES * 1000000000 / (end - start) )) OK/s," \
+        "$perSync records per sync"
+done
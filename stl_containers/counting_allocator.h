@@ -0,0 +1,77 @@
+#ifndef COUNTING_ALLOCATOR_H
+#define COUNTING_ALLOCATOR_H
+
+// Allocator that keeps statistics of the memory a container uses, so that
+// the cost of every ticket can be measured.
+//
+// Containers with the same Tag share their Statistics. The statistics are
+// kept per thread, which costs no synchronization; they describe the
+// containers used by the calling thread.
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+namespace counting_allocator {
+
+struct Statistics {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    // as requested by the container
+    size_t liveBytes = 0;
+    // as handed out by malloc, which rounds up requests
+    size_t liveUsableBytes = 0;
+
+    size_t liveAllocations() const noexcept {
+        return allocations - deallocations;
+    }
+};
+
+template <typename Tag>
+Statistics& statistics() noexcept {
+    thread_local Statistics tagStatistics;
+    return tagStatistics;
+}
+
+template <typename T, typename Tag>
+class Allocator {
+public:
+    using value_type = T;
+
+    Allocator() noexcept = default;
+
+    template <typename U>
+    Allocator(Allocator<U, Tag> const&) noexcept {}
+
+    T* allocate(size_t count) {
+        void* memory = std::malloc(count * sizeof(T));
+
+        if (!memory)
+            throw std::bad_alloc();
+
+        Statistics& tagStatistics = statistics<Tag>();
+        tagStatistics.allocations++;
+        tagStatistics.liveBytes += count * sizeof(T);
+        tagStatistics.liveUsableBytes += malloc_usable_size(memory);
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* memory, size_t count) noexcept {
+        Statistics& tagStatistics = statistics<Tag>();
+        tagStatistics.deallocations++;
+        tagStatistics.liveBytes -= count * sizeof(T);
+        tagStatistics.liveUsableBytes -= malloc_usable_size(memory);
+        std::free(memory);
+    }
+
+    template <typename U>
+    bool operator==(Allocator<U, Tag> const&) const noexcept {
+        return true;
+    }
+};
+
+}  // namespace counting_allocator
+
+#endif  // COUNTING_ALLOCATOR_H
@@ -0,0 +1,145 @@
+#ifndef CUCKOO_FILTER_H
+#define CUCKOO_FILTER_H
+
+// Approximate set of registrations that supports deletion (a cuckoo filter).
+// Every key is represented by a 16-bit fingerprint kept in one of its two
+// buckets of four. The second bucket is computed from the first one and the
+// fingerprint alone, so fingerprints can be moved to their other bucket to
+// make room. A negative answer is always right; a positive one is wrong with
+// probability of about 8 / 2^16. A key may be inserted several times and
+// then has to be erased as many times.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace cuckoo_filter {
+
+constexpr size_t BUCKET_SLOTS = 4;
+constexpr size_t MAXIMAL_KICKS = 500;
+constexpr uint16_t EMPTY = 0;
+
+class Filter {
+public:
+    // bucketCount has to be a power of two
+    explicit Filter(size_t bucketCount = 1 << 10) : buckets(bucketCount) {}
+
+    size_t bucketCount() const noexcept {
+        return buckets.size();
+    }
+
+    size_t memoryUsage() const noexcept {
+        return buckets.size() * sizeof(Bucket);
+    }
+
+    // Returns false when no room could be made for key. The filter has lost
+    // some other fingerprint then, so it has to be rebuilt bigger.
+    bool insert(uint64_t key) {
+        auto [fingerprint, index] = locate(key);
+
+        if (put(index, fingerprint) || put(alternate(index, fingerprint),
+                                           fingerprint))
+            return true;
+
+        for (size_t kick = 0; kick < MAXIMAL_KICKS; kick++) {
+            std::swap(fingerprint, buckets[index][nextRandom() % BUCKET_SLOTS]);
+            index = alternate(index, fingerprint);
+
+            if (put(index, fingerprint))
+                return true;
+        }
+
+        return false;
+    }
+
+    void erase(uint64_t key) noexcept {
+        auto [fingerprint, index] = locate(key);
+
+        if (!remove(index, fingerprint))
+            remove(alternate(index, fingerprint), fingerprint);
+    }
+
+    bool mayContain(uint64_t key) const noexcept {
+        auto [fingerprint, index] = locate(key);
+
+        return holds(index, fingerprint) ||
+               holds(alternate(index, fingerprint), fingerprint);
+    }
+
+private:
+    using Bucket = std::array<uint16_t, BUCKET_SLOTS>;
+
+    std::vector<Bucket> buckets;
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+
+    static uint64_t mix(uint64_t key) noexcept {
+        // finalizer of SplitMix64
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    size_t mask() const noexcept {
+        return buckets.size() - 1;
+    }
+
+    // fingerprint and first bucket of key; fingerprints are never EMPTY
+    std::pair<uint16_t, size_t> locate(uint64_t key) const noexcept {
+        uint64_t hash = mix(key);
+        uint16_t fingerprint = hash >> 48;
+
+        return {fingerprint == EMPTY ? 1 : fingerprint, hash & mask()};
+    }
+
+    size_t alternate(size_t index, uint16_t fingerprint) const noexcept {
+        return (index ^ mix(fingerprint)) & mask();
+    }
+
+    uint64_t nextRandom() noexcept {
+        // xorshift64
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        return random;
+    }
+
+    bool put(size_t index, uint16_t fingerprint) noexcept {
+        for (uint16_t& slot : buckets[index]) {
+            if (slot == EMPTY) {
+                slot = fingerprint;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool remove(size_t index, uint16_t fingerprint) noexcept {
+        for (uint16_t& slot : buckets[index]) {
+            if (slot == fingerprint) {
+                slot = EMPTY;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool holds(size_t index, uint16_t fingerprint) const noexcept {
+        for (uint16_t slot : buckets[index]) {
+            if (slot == fingerprint)
+                return true;
+        }
+
+        return false;
+    }
+};
+
+}  // namespace cuckoo_filter
+
+#endif  // CUCKOO_FILTER_H
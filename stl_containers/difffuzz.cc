@@ -0,0 +1,343 @@
+// Differential testing of the parking verifier against the reference
+// verifier on random streams of lines.
+//
+// usage: difffuzz [--seed N] [--rounds N] [--lines N] [-- COMMAND [ARGS...]]
+//
+// Every round generates a stream, mostly of well-formed purchases and
+// queries for a small set of cars with a clock that wraps around, and runs
+// it through the reference (this program with --reference) and through
+// COMMAND, ./parking by default, both reading it from a file. Their stdout
+// and stderr have to be equal line for line. On the first difference the
+// stream is minimised, saved as difffuzz-SEED.in and the difference shown.
+// At the end the throughput of both, including starting them, is reported.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "reference_verifier.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::string_view USAGE =
+    " [--seed N] [--rounds N] [--lines N] [-- COMMAND ...]";
+constexpr size_t PLATE_COUNT = 64;
+
+class StreamGenerator {
+public:
+    explicit StreamGenerator(uint64_t seed) : random(seed) {
+        for (size_t i = 0; i < PLATE_COUNT; i++)
+            plates.push_back(plate(3 + below(9)));
+    }
+
+    std::string line() {
+        size_t kind = below(100);
+
+        // the clock mostly moves forward a little, sometimes past closing
+        // time to the next day
+        minute += below(100) < 5 ? 0 : below(4);
+
+        if (minute > 20 * 60 + 10 || kind < 2)
+            minute = 7 * 60 + 50 + below(20);
+
+        std::string car = plates[below(plates.size())];
+
+        if (kind < 45)
+            return car + " " + time(minute) + " " +
+                   time(minute + below(13 * 60) - 60);
+
+        if (kind < 88)
+            return car + " " + time(minute);
+
+        return malformed(car);
+    }
+
+private:
+    std::mt19937_64 random;
+    std::vector<std::string> plates;
+    int minute = 8 * 60;
+
+    size_t below(size_t bound) {
+        return random() % bound;
+    }
+
+    std::string plate(size_t length) {
+        constexpr std::string_view LETTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        constexpr std::string_view CHARACTERS =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+        std::string result(1, LETTERS[below(LETTERS.size())]);
+
+        while (result.size() < length)
+            result += CHARACTERS[below(CHARACTERS.size())];
+
+        return result;
+    }
+
+    // H.MM, wrapping around to the morning, sometimes with a leading zero
+    std::string time(int minutes) {
+        if (minutes > 20 * 60 + 10)
+            minutes -= 12 * 60 + 20;
+
+        minutes = std::max(minutes, 7 * 60);
+
+        std::string hours = std::to_string(minutes / 60);
+        std::string rest = std::to_string(100 + minutes % 60).substr(1);
+
+        if (hours.size() == 1 && below(10) == 0)
+            hours = "0" + hours;
+
+        return hours + "." + rest;
+    }
+
+    std::string malformed(std::string const& car) {
+        switch (below(10)) {
+        case 0:
+            return "\t " + car + "  " + time(minute) + "\t";
+        case 1:
+            return car.substr(0, 2) + " " + time(minute);
+        case 2:
+            return car + "XYZ12345678 " + time(minute);
+        case 3:
+            return car + " " + std::to_string(minute / 60) + ".60";
+        case 4:
+            return car + " " + std::to_string(minute / 60) + "." +
+                   std::to_string(minute % 6);
+        case 5:
+            return car + " 24.00";
+        case 6:
+            return car + " " + time(minute) + " " + time(minute + 30) + " " +
+                   time(minute + 60);
+        case 7:
+            return "";
+        case 8: {
+            std::string lower = car;
+            lower[0] = lower[0] - 'A' + 'a';
+            return lower + " " + time(minute);
+        }
+        default: {
+            std::string garbage = car + " " + time(minute);
+            garbage[below(garbage.size())] = char(' ' + below(95));
+            return garbage;
+        }
+        }
+    }
+};
+
+struct Run {
+    std::string out;
+    std::string errors;
+    Clock::duration elapsed{};
+};
+
+std::string readFile(std::string const& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// Runs command with input as a file on stdin.
+Run run(std::vector<char*> const& command, std::string const& input) {
+    std::string inPath = "/tmp/difffuzz-in-" + std::to_string(getpid());
+    std::string outPath = inPath + ".out", errorsPath = inPath + ".err";
+
+    std::ofstream(inPath, std::ios::binary) << input;
+
+    auto start = Clock::now();
+    pid_t child = fork();
+
+    if (child == 0) {
+        int in = open(inPath.c_str(), O_RDONLY);
+        int out = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        int errors = open(errorsPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                          0600);
+
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(errors, STDERR_FILENO);
+        execvp(command[0], command.data());
+        _exit(127);
+    }
+
+    waitpid(child, nullptr, 0);
+
+    Run result{readFile(outPath), readFile(errorsPath), Clock::now() - start};
+
+    for (std::string const& path : {inPath, outPath, errorsPath})
+        unlink(path.c_str());
+
+    return result;
+}
+
+// Describes the first line in which expected and actual differ, or returns
+// an empty string when they are equal.
+std::string difference(std::string_view stream, std::string const& expected,
+                       std::string const& actual) {
+    std::istringstream expectedLines(expected), actualLines(actual);
+    std::string expectedLine, actualLine;
+
+    for (size_t line = 1;; line++) {
+        bool expectedMore = bool(std::getline(expectedLines, expectedLine));
+        bool actualMore = bool(std::getline(actualLines, actualLine));
+
+        if (!expectedMore && !actualMore)
+            return "";
+
+        if (expectedMore != actualMore || expectedLine != actualLine) {
+            return std::string(stream) + " line " + std::to_string(line) +
+                   ": reference \"" + (expectedMore ? expectedLine : "") +
+                   "\", verifier \"" + (actualMore ? actualLine : "") + "\"";
+        }
+    }
+}
+
+std::string join(std::vector<std::string> const& lines) {
+    std::string result;
+
+    for (std::string const& line : lines)
+        result.append(line).push_back('\n');
+
+    return result;
+}
+
+class Comparison {
+public:
+    Comparison(char* self, std::vector<char*> command)
+        : reference{self, const_cast<char*>("--reference"), nullptr},
+          command(std::move(command)) {
+        this->command.push_back(nullptr);
+    }
+
+    // Returns the first difference between the answers to input.
+    std::string check(std::string const& input) {
+        Run expected = run(reference, input);
+        Run actual = run(command, input);
+
+        referenceTime += expected.elapsed;
+        commandTime += actual.elapsed;
+
+        std::string found = difference("stdout", expected.out, actual.out);
+        return found.empty()
+                   ? difference("stderr", expected.errors, actual.errors)
+                   : found;
+    }
+
+    // Removes as many lines as it can while the answers still differ
+    // (delta debugging).
+    std::vector<std::string> minimise(std::vector<std::string> lines) {
+        size_t parts = 2;
+
+        while (lines.size() >= 2) {
+            size_t partSize = (lines.size() + parts - 1) / parts;
+            bool removed = false;
+
+            for (size_t begin = 0; begin < lines.size(); begin += partSize) {
+                std::vector<std::string> rest(lines.begin(),
+                                              lines.begin() + begin);
+                rest.insert(rest.end(),
+                            lines.begin() + std::min(begin + partSize,
+                                                     lines.size()),
+                            lines.end());
+
+                if (!check(join(rest)).empty()) {
+                    lines = std::move(rest);
+                    parts = std::max<size_t>(parts - 1, 2);
+                    removed = true;
+                    break;
+                }
+            }
+
+            if (!removed) {
+                if (partSize == 1)
+                    break;
+
+                parts = std::min(2 * parts, lines.size());
+            }
+        }
+
+        return lines;
+    }
+
+    Clock::duration referenceTime{}, commandTime{};
+
+private:
+    std::vector<char*> reference;
+    std::vector<char*> command;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc == 2 && std::string_view(argv[1]) == "--reference") {
+        std::ios::sync_with_stdio(false);
+        reference_verifier::Verifier().run(std::cin, std::cout, std::cerr);
+        return 0;
+    }
+
+    uint64_t seed = std::random_device()();
+    size_t rounds = 20, lines = 10000;
+    std::vector<char*> command{const_cast<char*>("./parking")};
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view option(argv[i]);
+
+        if (option == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (option == "--rounds" && i + 1 < argc) {
+            rounds = std::stoul(argv[++i]);
+        } else if (option == "--lines" && i + 1 < argc) {
+            lines = std::stoul(argv[++i]);
+        } else if (option == "--" && i + 1 < argc) {
+            command.assign(argv + i + 1, argv + argc);
+            break;
+        } else {
+            std::cerr << "usage: " << argv[0] << USAGE << "\n";
+            return 1;
+        }
+    }
+
+    Comparison comparison(const_cast<char*>("/proc/self/exe"), command);
+    StreamGenerator generator(seed);
+
+    std::cout << "seed " << seed << std::endl;
+
+    for (size_t round = 0; round < rounds; round++) {
+        std::vector<std::string> stream(lines);
+
+        std::generate(stream.begin(), stream.end(),
+                      [&] { return generator.line(); });
+
+        if (comparison.check(join(stream)).empty())
+            continue;
+
+        stream = comparison.minimise(std::move(stream));
+
+        std::string path = "difffuzz-" + std::to_string(seed) + ".in";
+        std::ofstream(path, std::ios::binary) << join(stream);
+        std::cout << "round " << round << ": "
+                  << comparison.check(join(stream)) << "\n"
+                  << "minimised to " << stream.size() << " lines in " << path
+                  << "\n";
+        return 1;
+    }
+
+    using Seconds = std::chrono::duration<double>;
+    double total = double(rounds) * lines;
+    double referenceSeconds = Seconds(comparison.referenceTime).count();
+    double commandSeconds = Seconds(comparison.commandTime).count();
+
+    std::cout << "lines " << rounds * lines << " without differences\n"
+              << "reference " << total / referenceSeconds << " lines/s\n"
+              << "verifier " << total / commandSeconds << " lines/s\n"
+              << "relative throughput " << referenceSeconds / commandSeconds
+              << "\n";
+}
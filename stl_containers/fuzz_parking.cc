@@ -0,0 +1,111 @@
+// libFuzzer harness checking the verifier against the reference verifier:
+// both get the same bytes as input and must give the same answers, line for
+// line. The verifier is parking.cc itself, its main loop run as main()
+// would on standard input, with MirrorHooks and once with and once without
+// the negative filter. Options that need files (--import, --journal) or
+// change the answers (--fuzzy) are not covered.
+//
+//   make fuzz_parking
+//   ./fuzz_parking -minimize_crash=1 CRASH_FILE   (to shrink a failure)
+//
+// Without libFuzzer (make fuzz_parking_check) the harness runs the files
+// given as arguments once each instead, e.g. to reproduce a failure.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#define PARKING_NO_MAIN
+#include "parking.cc"
+#include "reference_verifier.h"
+
+// Runs the verifier on in rather than the standard streams.
+void verify(std::istream& in, std::ostream& out, std::ostream& errors,
+            bool filter) {
+    std::streambuf* standardIn = std::cin.rdbuf(in.rdbuf());
+    std::streambuf* standardOut = std::cout.rdbuf(out.rdbuf());
+    std::streambuf* standardErrors = std::cerr.rdbuf(errors.rdbuf());
+
+    negativeFilter = filter;
+    activeFilter = cuckoo_filter::Filter();
+    run<DefaultRules>();
+
+    std::cin.rdbuf(standardIn);
+    std::cin.clear();
+    std::cout.rdbuf(standardOut);
+    std::cerr.rdbuf(standardErrors);
+}
+
+// Returns the number of the first line in which expected and actual
+// differ, or 0 when they are equal.
+size_t firstDifference(std::string const& expected, std::string const& actual) {
+    std::istringstream expectedLines(expected), actualLines(actual);
+    std::string expectedLine, actualLine;
+
+    for (size_t line = 1;; line++) {
+        bool expectedMore = bool(std::getline(expectedLines, expectedLine));
+        bool actualMore = bool(std::getline(actualLines, actualLine));
+
+        if (expectedMore != actualMore || expectedLine != actualLine)
+            return line;
+
+        if (!expectedMore)
+            return 0;
+    }
+}
+
+void compare(std::string_view stream, std::string const& expected,
+             std::string const& actual) {
+    size_t line = firstDifference(expected, actual);
+
+    if (line == 0)
+        return;
+
+    std::cerr << stream << " differs from the reference at line " << line
+              << "\nreference:\n" << expected << "verifier:\n" << actual;
+    std::abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+    std::string input(reinterpret_cast<char const*>(data), size);
+    std::istringstream referenceIn(input);
+    std::ostringstream referenceOut, referenceErrors;
+
+    reference_verifier::Verifier().run(referenceIn, referenceOut,
+                                       referenceErrors);
+
+    for (bool filter : {false, true}) {
+        std::istringstream verifierIn(input);
+        std::ostringstream verifierOut, verifierErrors;
+
+        verify(verifierIn, verifierOut, verifierErrors, filter);
+        compare("stdout", referenceOut.str(), verifierOut.str());
+        compare("stderr", referenceErrors.str(), verifierErrors.str());
+    }
+
+    return 0;
+}
+
+#ifndef LIBFUZZER
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+
+        if (!file) {
+            std::cerr << "cannot read " << argv[i] << "\n";
+            return 1;
+        }
+
+        std::string input(std::istreambuf_iterator<char>(file), {});
+
+        LLVMFuzzerTestOneInput(reinterpret_cast<uint8_t const*>(input.data()),
+                               input.size());
+    }
+}
+#endif
@@ -0,0 +1,111 @@
+#ifndef JOURNAL_FORMAT_H
+#define JOURNAL_FORMAT_H
+
+// Binary log of the events that changed the state of the verifier, as
+// written by `parking --journal FILE` and read back to recover the state.
+//
+// After JOURNAL_MAGIC come records of RECORD_SIZE bytes, all numbers
+// little-endian:
+//
+//   line id u64 | registration u64 | begin u32 | end u32 | kind u32 | checksum u32
+//
+// Builds with wide plates write registrations of 128 bits, and a different
+// magic, so that neither build reads the journal of the other. Times are
+// in seconds after midnight. The checksum covers the rest of the
+// record, so that a record torn by a crash is recognized and dropped.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "parking_engine.h"
+#include "registration.h"
+
+namespace journal {
+
+#ifdef PARKING_WIDE_PLATES
+constexpr std::string_view JOURNAL_MAGIC = "PKJOURW1";
+#else
+constexpr std::string_view JOURNAL_MAGIC = "PKJOURN1";
+#endif
+constexpr size_t REGISTRATION_SIZE = sizeof(Registration);
+constexpr size_t RECORD_SIZE = 24 + REGISTRATION_SIZE;
+
+struct Record {
+    enum class Kind : uint32_t {
+        // an accepted ticket
+        Purchase = 1,
+        // the clock moved to the time of an event that carries no ticket,
+        // end is unused
+        Clock = 2,
+    };
+
+    Kind kind = Kind::Purchase;
+    uint64_t lineId = 0;
+    Registration registration = 0;
+    Time begin{};
+    Time end{};
+};
+
+inline uint32_t checksum(unsigned char const* data, size_t size) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+inline void appendRecord(std::string& out, Record const& record) {
+    unsigned char bytes[RECORD_SIZE];
+
+    auto put = [&](size_t offset, Registration value, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            bytes[offset + i] = static_cast<unsigned char>(value >> (8 * i));
+    };
+    size_t times = 8 + REGISTRATION_SIZE;
+
+    put(0, record.lineId, 8);
+    put(8, record.registration, REGISTRATION_SIZE);
+    put(times, timeToSeconds(record.begin), 4);
+    put(times + 4, timeToSeconds(record.end), 4);
+    put(times + 8, static_cast<uint32_t>(record.kind), 4);
+    put(times + 12, checksum(bytes, RECORD_SIZE - 4), 4);
+    out.append(reinterpret_cast<char const*>(bytes), RECORD_SIZE);
+}
+
+// Reads the record at data, returns false if it is damaged.
+inline bool decodeRecord(char const* data, Record& record) {
+    auto bytes = reinterpret_cast<unsigned char const*>(data);
+
+    auto get = [&](size_t offset, size_t size) {
+        Registration value = 0;
+
+        for (size_t i = 0; i < size; i++)
+            value |= Registration{bytes[offset + i]} << (8 * i);
+
+        return value;
+    };
+    size_t times = 8 + REGISTRATION_SIZE;
+    uint32_t kind = get(times + 8, 4);
+
+    if (get(times + 12, 4) != checksum(bytes, RECORD_SIZE - 4) ||
+        (kind != uint32_t(Record::Kind::Purchase) &&
+         kind != uint32_t(Record::Kind::Clock)))
+        return false;
+
+    record.lineId = get(0, 8);
+    record.registration = get(8, REGISTRATION_SIZE);
+    record.begin = Time::fromSeconds(get(times, 4));
+    record.end = Time::fromSeconds(get(times + 4, 4));
+    record.kind = Record::Kind(kind);
+    return true;
+}
+
+}  // namespace journal
+
+#endif  // JOURNAL_FORMAT_H
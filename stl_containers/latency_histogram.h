@@ -0,0 +1,144 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// Cheap measurement of short durations: a clock reading the time stamp
+// counter and a log-linear (HDR-style) histogram of the measured values.
+//
+// The histogram splits every power of two into SUB_BUCKETS equal buckets,
+// so recording a value is a few instructions and every quantile it reports
+// is within 1 / SUB_BUCKETS of the true one, whatever the range of values.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace latency_histogram {
+
+constexpr unsigned SUB_BUCKET_BITS = 5;
+constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+class Histogram {
+public:
+    void record(uint64_t value) noexcept {
+        counts[index(value)]++;
+        total++;
+        maximum = std::max(maximum, value);
+    }
+
+    void add(Histogram const& other) noexcept {
+        for (size_t i = 0; i < BUCKET_COUNT; i++)
+            counts[i] += other.counts[i];
+
+        total += other.total;
+        maximum = std::max(maximum, other.maximum);
+    }
+
+    void reset() noexcept {
+        counts.fill(0);
+        total = 0;
+        maximum = 0;
+    }
+
+    uint64_t count() const noexcept {
+        return total;
+    }
+
+    uint64_t max() const noexcept {
+        return maximum;
+    }
+
+    // The smallest value that at least fraction of the recorded values do
+    // not exceed, rounded up to the end of its bucket.
+    uint64_t valueAt(double fraction) const noexcept {
+        uint64_t rank = std::max<uint64_t>(1, fraction * total + 0.5);
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            seen += counts[i];
+
+            if (seen >= rank)
+                return std::min(maximum, highestValue(i));
+        }
+
+        return maximum;
+    }
+
+private:
+    std::array<uint64_t, BUCKET_COUNT> counts{};
+    uint64_t total = 0;
+    uint64_t maximum = 0;
+
+    static size_t index(uint64_t value) noexcept {
+        unsigned width = std::bit_width(value);
+        unsigned shift = width > SUB_BUCKET_BITS + 1
+                             ? width - SUB_BUCKET_BITS - 1 : 0;
+
+        return shift * SUB_BUCKETS + (value >> shift);
+    }
+
+    static uint64_t highestValue(size_t index) noexcept {
+        unsigned shift = index < 2 * SUB_BUCKETS ? 0 : index / SUB_BUCKETS - 1;
+        uint64_t first = (index - shift * SUB_BUCKETS) << shift;
+
+        return first + ((uint64_t{1} << shift) - 1);
+    }
+};
+
+// Time stamp counter, or the steady clock in nanoseconds where there is
+// none. The counter runs at a constant rate on current processors, which
+// is measured against the steady clock since start(); the longer the clock
+// runs, the more precise calibrate() gets.
+class TickClock {
+public:
+    static uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Takes about a millisecond for the first calibration.
+    void start() {
+        wallStart = std::chrono::steady_clock::now();
+        tickStart = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        calibrate();
+    }
+
+    void calibrate() {
+        uint64_t ticks = now() - tickStart;
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - wallStart);
+
+        if (ticks > 0)
+            nanosecondsPerTick = double(elapsed.count()) / ticks;
+    }
+
+    double nanoseconds(uint64_t ticks) const noexcept {
+        return ticks * nanosecondsPerTick;
+    }
+
+    uint64_t ticks(std::chrono::nanoseconds duration) const noexcept {
+        return duration.count() / nanosecondsPerTick;
+    }
+
+private:
+    std::chrono::steady_clock::time_point wallStart;
+    uint64_t tickStart = 0;
+    double nanosecondsPerTick = 1;
+};
+
+}  // namespace latency_histogram
+
+#endif  // LATENCY_HISTOGRAM_H
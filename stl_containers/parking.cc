@@ -2,187 +2,1917 @@
 
 #include <iostream>
 #include <cstdint>
-#include <regex>
 #include <unordered_map>
 #include <utility>
 #include <set>
-#include <charconv>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <bit>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <system_error>
 
-// hours and minutes
-using Time = std::pair<uint16_t, uint16_t>; 
-using TimeInterval = std::pair<Time, Time>;
-// we can keep registration encoded in 64 bits
-using Registration = uint64_t;
-using RegisteredCars = std::unordered_map<Registration, Time>;
-using Tickets = std::set<std::pair<Time, Registration>>;
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-RegisteredCars registeredCars{};
-Tickets tickets{};
+#include "counting_allocator.h"
+#include "cuckoo_filter.h"
+#include "journal_format.h"
+#include "latency_histogram.h"
+#include "parking_engine.h"
+#include "parking_input.h"
+#include "parking_shm.h"
+#include "registration.h"
+#include "replay_format.h"
+#include "seqlock_table.h"
+#include "uring_streams.h"
 
-constexpr uint16_t timeToMinutes(Time time) {
-    return 60 * time.first + time.second;
+// Times may also be given to the second, as H.MM.SS, with --seconds.
+bool secondsResolution = false;
+
+// Fuzzy matching of registrations misread by OCR (enabled with --fuzzy).
+// Registrations are compared in a canonical form in which characters
+// that cameras confuse are equal. Two canonical registrations are within
+// edit distance 1 iff one of them, or one of its single-character
+// deletions, equals the other one or one of its deletions. Every active
+// registration is therefore indexed under its canonical form and all its
+// deletions, so a query needs at most 12 hash lookups.
+struct PlateIndexMemory {};
+
+using PlateIndex = std::unordered_multimap<
+    Registration, Registration, RegistrationHash,
+    std::equal_to<Registration>,
+    counting_allocator::Allocator<std::pair<Registration const, Registration>,
+                                  PlateIndexMemory>>;
+
+bool fuzzyMatching = false;
+PlateIndex plateIndex{};
+
+constexpr char canonicalCharacter(char c) {
+    switch (c) {
+    case 'O':
+        return '0';
+    case 'I':
+        return '1';
+    case 'B':
+        return '8';
+    default:
+        return c;
+    }
+}
+
+std::string canonicalPlate(Registration registration) {
+    std::string plate = registrationToString(registration);
+    std::transform(plate.begin(), plate.end(), plate.begin(),
+                   canonicalCharacter);
+    return plate;
+}
+
+// Canonical form followed by all distinct single-character deletions.
+std::vector<Registration> plateIndexKeys(std::string_view canonical) {
+    std::vector<Registration> keys{registrationFromString(canonical)};
+    std::string deleted;
+
+    for (size_t i = 0; i < canonical.length(); i++) {
+        // deleting any character of a run gives the same string
+        if (i > 0 && canonical[i] == canonical[i - 1])
+            continue;
+
+        deleted.assign(canonical.substr(0, i));
+        deleted.append(canonical.substr(i + 1));
+        keys.push_back(registrationFromString(deleted));
+    }
+
+    return keys;
+}
+
+bool withinOneEdit(std::string_view lhs, std::string_view rhs) {
+    if (lhs.length() < rhs.length())
+        std::swap(lhs, rhs);
+
+    if (lhs.length() - rhs.length() > 1)
+        return false;
+
+    auto [lhsIt, rhsIt] = std::mismatch(lhs.begin(), lhs.end(),
+                                        rhs.begin(), rhs.end());
+    size_t prefix = lhsIt - lhs.begin();
+
+    if (lhs.length() == rhs.length())
+        return prefix == lhs.length() ||
+               lhs.substr(prefix + 1) == rhs.substr(prefix + 1);
+
+    return lhs.substr(prefix + 1) == rhs.substr(prefix);
+}
+
+void addToPlateIndex(Registration car) {
+    for (Registration key : plateIndexKeys(canonicalPlate(car)))
+        plateIndex.emplace(key, car);
+}
+
+void removeFromPlateIndex(Registration car) {
+    for (Registration key : plateIndexKeys(canonicalPlate(car))) {
+        auto [begin, end] = plateIndex.equal_range(key);
+        auto entry = std::find_if(begin, end, [&](auto const& e) {
+            return e.second == car;
+        });
+
+        if (entry != end)
+            plateIndex.erase(entry);
+    }
+}
+
+// Active registrations other than car within edit distance 1 of it,
+// sorted by their text.
+std::vector<std::string> similarActivePlates(Registration car) {
+    std::string canonical = canonicalPlate(car);
+    std::set<std::string> found;
+
+    for (Registration key : plateIndexKeys(canonical)) {
+        auto [begin, end] = plateIndex.equal_range(key);
+
+        std::for_each(begin, end, [&](auto const& e) {
+            if (e.second != car &&
+                withinOneEdit(canonical, canonicalPlate(e.second)))
+                found.insert(registrationToString(e.second));
+        });
+    }
+
+    return {found.begin(), found.end()};
+}
+
+// Most queried cars never bought a ticket. A filter of active
+// registrations answers those queries without touching registeredCars
+// (--filter). It pays off only when registeredCars is far out of cache,
+// so it is off by default.
+bool negativeFilter = false;
+cuckoo_filter::Filter activeFilter;
+size_t filterQueries = 0;
+size_t filterNegatives = 0;
+size_t filterFalsePositives = 0;
+
+// The filter takes 64 bit keys, wide registrations are hashed down to them.
+uint64_t filterKey(Registration car) {
+#ifdef PARKING_WIDE_PLATES
+    return RegistrationHash{}(car);
+#else
+    return car;
+#endif
+}
+
+// Used when a registration does not fit into the filter any more, or to
+// shrink it when most registrations have left.
+void rebuildFilter(RegisteredCars const& registeredCars, size_t bucketCount) {
+    do {
+        activeFilter = cuckoo_filter::Filter(bucketCount);
+        bucketCount *= 2;
+    } while (!std::all_of(registeredCars.begin(), registeredCars.end(),
+                          [](auto const& car) {
+                              return activeFilter.insert(filterKey(car.first));
+                          }));
+}
+
+template <typename Engine>
+bool ticketActive(Engine const& engine, Registration car) {
+    if (negativeFilter) {
+        filterQueries++;
+
+        if (!activeFilter.mayContain(filterKey(car))) {
+            filterNegatives++;
+            return false;
+        }
+    }
+
+    if (!engine.ticketActive(car)) {
+        filterFalsePositives += negativeFilter;
+        return false;
+    }
+
+    return true;
+}
+
+// Concurrent mode (--readers N): the main thread is the only writer and
+// mirrors registeredCars into a table that reader threads query without
+// locks. A query is answered from the table as it is at the time of the
+// query: before the entry of a car changes, the writer waits for the
+// readers to answer the queries for that car it has handed them (see
+// awaitQueries), but not for the others. The table cannot grow in place,
+// so a bigger one is published instead; the old ones are kept until exit.
+using seqlock_table::Table;
+using TableRegion = std::unique_ptr<void, decltype(&std::free)>;
+
+size_t readerCount = 0;
+std::atomic<Table*> concurrentTable{nullptr};
+std::vector<std::pair<TableRegion, std::unique_ptr<Table>>> concurrentTables;
+// clock of the tables mirroring registeredCars
+Time mirroredClock{8, 0};
+
+constexpr uint32_t INITIAL_TABLE_BUCKETS = 1 << 12;
+
+void publishConcurrentTable(RegisteredCars const& registeredCars,
+                            uint32_t bucketCount) {
+    TableRegion region(std::aligned_alloc(alignof(seqlock_table::Bucket),
+                                          Table::regionSize(bucketCount)),
+                       &std::free);
+    auto table = std::make_unique<Table>(region.get(), bucketCount);
+
+    for (auto [car, end] : registeredCars)
+        table->insert(car, timeToSeconds(end));
+
+    table->setClock(timeToSeconds(mirroredClock));
+    concurrentTable.store(table.get(), std::memory_order_release);
+    concurrentTables.emplace_back(std::move(region), std::move(table));
+}
+
+// Queries handed by the writer to one reader thread, together with the
+// number of their line. A query keeps its slot until it is answered, and
+// its position tells the writer when that has happened. Both sides sleep
+// rather than spin when they have to wait, and wake the other one only if
+// it may be asleep.
+class QueryQueue {
+public:
+    using Query = std::pair<size_t, Registration>;
+
+    // Returns the position of query, see awaitAnswered.
+    size_t push(Query query) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+
+        if (tail >= CAPACITY)
+            awaitAnswered(tail + 1 - CAPACITY);
+
+        queries[tail % CAPACITY] = query;
+        this->tail.store(tail + 1);
+
+        if (readerSleeping.exchange(false))
+            this->tail.notify_one();
+
+        return tail + 1;
+    }
+
+    // Waits for the next query, calling idle first if there is none yet;
+    // returns false once the queue is closed and drained. The query has to
+    // be answered before the next one.
+    template <typename Function>
+    bool next(Query& query, Function idle) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        size_t tail = this->tail.load(std::memory_order_acquire);
+
+        if (head == tail)
+            idle();
+
+        while (head == tail) {
+            readerSleeping.store(true);
+
+            if ((tail = this->tail.load()) == head)
+                this->tail.wait(tail);
+
+            tail = this->tail.load(std::memory_order_acquire);
+        }
+
+        if (head == (tail & ~CLOSED))
+            return false;
+
+        query = queries[head % CAPACITY];
+        return true;
+    }
+
+    void answered() {
+        head.store(head.load(std::memory_order_relaxed) + 1);
+
+        if (writerWaiting.load() && writerWaiting.exchange(false))
+            head.notify_one();
+    }
+
+    // Waits until the query at position, and every one before it, has been
+    // answered.
+    void awaitAnswered(size_t position) {
+        for (size_t head; (head = this->head.load()) < position;) {
+            writerWaiting.store(true);
+
+            if (this->head.load() == head)
+                this->head.wait(head);
+        }
+    }
+
+    void close() {
+        tail.fetch_or(CLOSED, std::memory_order_release);
+        tail.notify_all();
+    }
+
+private:
+    static constexpr size_t CAPACITY = 1 << 12;
+    // set in tail once no more queries come
+    static constexpr size_t CLOSED = size_t{1} << 63;
+
+    std::array<Query, CAPACITY> queries;
+    alignas(64) std::atomic<size_t> head{0};
+    std::atomic<bool> writerWaiting{false};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<bool> readerSleeping{false};
+};
+
+// The queries for a car go to the queue of its slot, which remembers the
+// position of the last query handed out for any of its cars.
+constexpr size_t QUERY_SLOTS = 1 << 16;
+
+std::vector<std::unique_ptr<QueryQueue>> queryQueues;
+std::vector<size_t> lastQueries;
+
+size_t querySlot(Registration car) {
+    return seqlock_table::mix(car) & (QUERY_SLOTS - 1);
+}
+
+void handOverQuery(Registration car, size_t lineId) {
+    size_t slot = querySlot(car);
+
+    lastQueries[slot] = queryQueues[slot % readerCount]->push({lineId, car});
+}
+
+// Waits until the readers have answered the queries for car handed to
+// them, so that its entry in the concurrent table can change without
+// affecting their answers. Queries for the other cars of its slot are
+// waited for too, those for the rest are not.
+void awaitQueries(Registration car) {
+    size_t slot = querySlot(car);
+
+    if (lastQueries[slot] > 0) {
+        queryQueues[slot % readerCount]->awaitAnswered(lastQueries[slot]);
+        lastQueries[slot] = 0;
+    }
+}
+
+// Export to shared memory (--shm NAME): registeredCars is mirrored into a
+// segment that other processes read with the client from parking_shm.h.
+std::string sharedName;
+uint32_t sharedBuckets = 1 << 16;
+parking_shm::Header* sharedHeader = nullptr;
+std::optional<Table> sharedTable;
+
+// Publishes a new segment under sharedName and retires the previous one.
+bool publishSharedTable(RegisteredCars const& registeredCars,
+                        uint32_t bucketCount) {
+    size_t size = parking_shm::segmentSize(bucketCount);
+
+    // clients that have mapped the old segment keep it until they move on;
+    // those attaching meanwhile wait for the version to be set
+    shm_unlink(sharedName.c_str());
+    int fd = shm_open(sharedName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    void* mapping = MAP_FAILED;
+
+    if (fd >= 0 && !ftruncate(fd, size))
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (fd >= 0)
+        close(fd);
+
+    if (mapping == MAP_FAILED) {
+        std::cerr << "cannot create shared memory " << sharedName << "\n";
+        return false;
+    }
+
+    auto header = new (mapping) parking_shm::Header{};
+    header->magic = parking_shm::MAGIC;
+    header->bucketCount = bucketCount;
+    sharedTable.emplace(header + 1, bucketCount);
+
+    for (auto [car, end] : registeredCars)
+        sharedTable->insert(car, timeToSeconds(end));
+
+    sharedTable->setClock(timeToSeconds(mirroredClock));
+    header->version.store(parking_shm::LAYOUT_VERSION,
+                          std::memory_order_release);
+
+    if (sharedHeader) {
+        sharedHeader->retired.store(1, std::memory_order_release);
+        munmap(sharedHeader, parking_shm::segmentSize(sharedHeader->bucketCount));
+    }
+
+    sharedHeader = header;
+    return true;
+}
+
+void stopSharing() {
+    if (sharedHeader) {
+        sharedHeader->retired.store(1, std::memory_order_release);
+        munmap(sharedHeader, parking_shm::segmentSize(sharedHeader->bucketCount));
+        shm_unlink(sharedName.c_str());
+    }
+
+    sharedHeader = nullptr;
+    sharedTable.reset();
+}
+
+// Tables mirroring registeredCars, once the readers are done with the
+// entry of car in the concurrent one.
+template <typename Function>
+void forEachMirror(Registration car, Function function) {
+    if (readerCount > 0) {
+        awaitQueries(car);
+        function(*concurrentTable.load(std::memory_order_relaxed));
+    }
+
+    if (sharedTable)
+        function(*sharedTable);
+}
+
+// Expiry notifications (--expired FILE): an "EXPIRED <registration> <end>"
+// line for every ticket that expires as the clock moves. The lines of a
+// move are added to a pending batch, which a background thread writes to
+// FILE once it is big enough or has waited expiryDelay, whether or not the
+// clock moves again. When FILE does not keep up and too much is already
+// waiting, lines are dropped instead of holding up the verification.
+//
+// Notifications start after the journal is recovered: the tickets that
+// recovery lets expire again were notified before the restart. Lines noted
+// before the writer starts wait for it in the pending batch.
+constexpr size_t EXPIRY_BATCH_SIZE = 1 << 12;
+constexpr size_t MAXIMAL_QUEUED_EXPIRIES = 1 << 24;  // bytes
+constexpr std::chrono::milliseconds EXPIRY_DELAY{100};
+
+int expiryFile = -1;
+bool notifyingExpiries = false;
+std::chrono::steady_clock::duration expiryDelay = EXPIRY_DELAY;
+// lines of the current move, kept by the main thread
+std::string expiryBatch;
+// guarded by expiryMutex
+std::string pendingExpiries;
+std::chrono::steady_clock::time_point pendingSince;
+std::deque<std::string> expiryQueue;
+size_t queuedExpiryBytes = 0;
+bool expiryClosing = false;
+std::mutex expiryMutex;
+std::condition_variable expiryReady;
+std::thread expiryWriter;
+size_t droppedExpiries = 0;
+
+// Queues the pending batch; called under expiryMutex.
+void queuePendingExpiries() {
+    if (!pendingExpiries.empty()) {
+        expiryQueue.push_back(std::move(pendingExpiries));
+        pendingExpiries.clear();
+    }
+}
+
+void writeExpiries() {
+    std::unique_lock lock(expiryMutex);
+
+    while (true) {
+        if (pendingExpiries.empty()) {
+            expiryReady.wait(lock, [] {
+                return expiryClosing || !expiryQueue.empty() ||
+                       !pendingExpiries.empty();
+            });
+        } else if (!expiryReady.wait_until(lock, pendingSince + expiryDelay, [] {
+                       return expiryClosing || !expiryQueue.empty();
+                   })) {
+            // the pending batch has waited long enough
+            queuePendingExpiries();
+        }
+
+        if (expiryClosing)
+            queuePendingExpiries();
+
+        if (expiryQueue.empty()) {
+            if (expiryClosing)
+                return;
+
+            continue;
+        }
+
+        std::string batch = std::move(expiryQueue.front());
+        expiryQueue.pop_front();
+        lock.unlock();
+
+        for (size_t written = 0; written < batch.size();) {
+            ssize_t result = write(expiryFile, batch.data() + written,
+                                   batch.size() - written);
+
+            if (result < 0 && errno == EINTR)
+                continue;
+
+            // nobody reads the notifications any more
+            if (result <= 0)
+                break;
+
+            written += result;
+        }
+
+        lock.lock();
+        queuedExpiryBytes -= batch.size();
+    }
+}
+
+void noteExpiry(Registration car, Time end) {
+    expiryBatch += "EXPIRED ";
+    expiryBatch += registrationToString(car);
+    expiryBatch += ' ';
+    expiryBatch += timeToString(end, secondsResolution);
+    expiryBatch += '\n';
 }
 
-constexpr uint16_t MINIMAL_PARKING_MINUTES = timeToMinutes(Time{0, 10});
-constexpr uint16_t MAXIMAL_PARKING_MINUTES = timeToMinutes(Time{11, 59});
-constexpr Time OPENING_TIME = Time{8, 0};
-constexpr Time CLOSING_TIME = Time{20, 0};
-constexpr Time AFTER_CLOSING_TIME = Time{20, 1};
+// Adds the lines of the move to the pending batch, which is queued at once
+// when it is big enough.
+void passExpiries() {
+    if (expiryBatch.empty())
+        return;
+
+    {
+        std::lock_guard lock(expiryMutex);
+
+        if (queuedExpiryBytes + expiryBatch.size() > MAXIMAL_QUEUED_EXPIRIES) {
+            droppedExpiries += std::count(expiryBatch.begin(),
+                                          expiryBatch.end(), '\n');
+            expiryBatch.clear();
+            return;
+        }
+
+        if (pendingExpiries.empty())
+            pendingSince = std::chrono::steady_clock::now();
+
+        queuedExpiryBytes += expiryBatch.size();
+        pendingExpiries += expiryBatch;
+
+        if (pendingExpiries.size() >= EXPIRY_BATCH_SIZE ||
+            expiryDelay == expiryDelay.zero())
+            queuePendingExpiries();
+    }
+
+    expiryReady.notify_one();
+    expiryBatch.clear();
+}
+
+void startExpiries() {
+    expiryWriter = std::thread(writeExpiries);
+}
+
+void stopExpiries() {
+    passExpiries();
+
+    {
+        std::lock_guard lock(expiryMutex);
+        expiryClosing = true;
+    }
+
+    expiryReady.notify_one();
+    expiryWriter.join();
+    close(expiryFile);
+
+    if (droppedExpiries > 0)
+        std::clog << droppedExpiries << " expiry notifications dropped\n";
+}
+
+// Keeps everything that mirrors registeredCars in sync with the engine.
+struct MirrorHooks {
+    void ticketStored(RegisteredCars const& registeredCars, Registration car,
+                      Time end, bool newCar) const {
+        if (newCar && fuzzyMatching)
+            addToPlateIndex(car);
+
+        if (newCar && negativeFilter && !activeFilter.insert(filterKey(car)))
+            rebuildFilter(registeredCars, 2 * activeFilter.bucketCount());
+
+        if (readerCount > 0) {
+            awaitQueries(car);
+            Table* table = concurrentTable.load(std::memory_order_relaxed);
+
+            if (!table->insert(car, timeToSeconds(end)))
+                publishConcurrentTable(registeredCars, 2 * table->bucketCount());
+        }
+
+        if (sharedTable && !sharedTable->insert(car, timeToSeconds(end)) &&
+            !publishSharedTable(registeredCars, 2 * sharedTable->bucketCount()))
+            stopSharing();
+    }
+
+    void ticketRemoved(Registration car, Time end) const {
+        if (notifyingExpiries)
+            noteExpiry(car, end);
+
+        if (fuzzyMatching)
+            removeFromPlateIndex(car);
+
+        if (negativeFilter)
+            activeFilter.erase(filterKey(car));
+
+        forEachMirror(car, [&](Table& table) {
+            table.erase(car);
+        });
+    }
+
+    // Readers of the concurrent table only need the entries of the cars
+    // they look up to stay put, so only the shared table, read by other
+    // processes, is locked for the whole move.
+    void clockMoving() const {
+        if (sharedTable)
+            sharedTable->beginUpdate();
+    }
+
+    void clockMoved(Time newTime) const {
+        mirroredClock = newTime;
+
+        if (readerCount > 0) {
+            Table* table = concurrentTable.load(std::memory_order_relaxed);
+
+            table->beginUpdate();
+            table->setClock(timeToSeconds(newTime));
+            table->endUpdate();
+        }
+
+        if (sharedTable) {
+            sharedTable->setClock(timeToSeconds(newTime));
+            sharedTable->endUpdate();
+        }
+
+        if (notifyingExpiries)
+            passExpiries();
+    }
+};
+
+// Write-ahead journal (--journal FILE) of the events that changed the
+// state: accepted purchases, and events that moved the clock. Every move
+// is recorded, as recovery has to end at the clock of the last event: from
+// an earlier clock a later event may not look like the next day. A
+// background thread writes the records and makes all that are waiting
+// durable with one fdatasync (group commit). An idle writer starts once
+// journalBatch records are waiting or the oldest is journalDelay old; the
+// records that come in during a sync wait for the next one in any case. So
+// journalBatch sets the size of a commit only while syncs are quicker than
+// the input fills a batch; on a slow disk the sync time sets it instead
+// (see journalSyncs with --stats, and bench_journal.sh).
+//
+// With --durable, the answers are held back until everything journaled
+// before them is durable, so an OK means that the ticket survives a crash.
+// An existing FILE is replayed into the engine first (recovery).
+constexpr size_t JOURNAL_BATCH = 64;
+constexpr std::chrono::milliseconds JOURNAL_DELAY{5};
+
+char const* journalPath = nullptr;
+int journalFile = -1;
+size_t journalBatch = JOURNAL_BATCH;
+std::chrono::steady_clock::duration journalDelay = JOURNAL_DELAY;
+bool durableAnswers = false;
+Time journalClock;
+
+struct JournalBatch {
+    std::string records;
+    size_t recordCount = 0;
+    std::chrono::steady_clock::time_point firstRecord;
+    // held back answers, with --durable
+    std::string answers;
+};
+
+JournalBatch pendingJournal;
+// counted by the writer
+size_t journalSyncs = 0;
+size_t journalSyncedRecords = 0;
+bool journalClosing = false;
+std::mutex journalMutex;
+std::condition_variable journalWake;
+std::thread journalWriter;
+
+bool journalBatchReady() {
+    if (pendingJournal.recordCount == 0)
+        return journalClosing || !pendingJournal.answers.empty();
+
+    return journalClosing || pendingJournal.recordCount >= journalBatch ||
+           std::chrono::steady_clock::now() - pendingJournal.firstRecord >=
+               journalDelay;
+}
+
+// Durability cannot be promised any more, so better stop.
+[[noreturn]] void journalFailed() {
+    std::cerr << "cannot write journal " << journalPath << "\n";
+    std::_Exit(1);
+}
+
+void writeJournal() {
+    std::unique_lock lock(journalMutex);
+
+    while (true) {
+        if (!journalBatchReady()) {
+            // held back answers come without a notification
+            auto wakeUp = pendingJournal.recordCount > 0
+                              ? pendingJournal.firstRecord + journalDelay
+                              : std::chrono::steady_clock::now() + journalDelay;
+
+            journalWake.wait_until(lock, wakeUp);
+            continue;
+        }
+
+        if (journalClosing && pendingJournal.recordCount == 0 &&
+            pendingJournal.answers.empty())
+            return;
+
+        JournalBatch batch = std::move(pendingJournal);
+        pendingJournal = {};
+        lock.unlock();
+
+        for (std::string_view records = batch.records; !records.empty();) {
+            ssize_t written = write(journalFile, records.data(),
+                                    records.size());
+
+            if (written < 0 && errno != EINTR)
+                journalFailed();
+
+            records.remove_prefix(std::max<ssize_t>(written, 0));
+        }
+
+        if (batch.recordCount > 0) {
+            if (fdatasync(journalFile))
+                journalFailed();
+
+            journalSyncs++;
+            journalSyncedRecords += batch.recordCount;
+        }
+
+        if (!batch.answers.empty()) {
+            std::cout.write(batch.answers.data(), batch.answers.size());
+            std::cout.flush();
+        }
+
+        lock.lock();
+    }
+}
+
+void journalRecord(journal::Record const& record) {
+    bool full;
+
+    {
+        std::lock_guard lock(journalMutex);
+
+        if (pendingJournal.recordCount++ == 0)
+            pendingJournal.firstRecord = std::chrono::steady_clock::now();
+
+        journal::appendRecord(pendingJournal.records, record);
+        full = pendingJournal.recordCount >= journalBatch;
+    }
+
+    if (full)
+        journalWake.notify_one();
+}
+
+// Records an event that the engine has admitted, if it changes the state.
+void journalEvent(Event const& event, size_t lineId) {
+    using journal::Record;
+
+    if (event.kind == Event::Kind::Purchase) {
+        journalRecord({Record::Kind::Purchase, lineId, event.registration,
+                       event.begin, event.end});
+    } else if (event.begin != journalClock) {
+        journalRecord({Record::Kind::Clock, lineId, event.registration,
+                       event.begin, {}});
+    }
+
+    journalClock = event.begin;
+}
+
+// Opens the journal and replays what it holds into engine. A damaged last
+// record, torn by a crash, is cut off.
+template <typename Engine>
+bool recoverJournal(Engine& engine) {
+    using journal::JOURNAL_MAGIC;
+    using journal::RECORD_SIZE;
+
+    journalFile = open(journalPath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat status;
+
+    if (journalFile < 0 || fstat(journalFile, &status)) {
+        std::cerr << "cannot open journal " << journalPath << "\n";
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t size = status.st_size, recovered = 0, end = JOURNAL_MAGIC.size();
+
+    if (size == 0) {
+        if (write(journalFile, JOURNAL_MAGIC.data(), JOURNAL_MAGIC.size()) !=
+                ssize_t(JOURNAL_MAGIC.size()) ||
+            fdatasync(journalFile))
+            journalFailed();
+    } else {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+                             journalFile, 0);
+
+        if (mapping == MAP_FAILED ||
+            std::string_view(static_cast<char const*>(mapping),
+                             std::min(size, JOURNAL_MAGIC.size())) !=
+                JOURNAL_MAGIC) {
+            std::cerr << "not a journal " << journalPath << "\n";
+            return false;
+        }
+
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        journal::Record record;
+
+        for (; end + RECORD_SIZE <= size &&
+               journal::decodeRecord(static_cast<char const*>(mapping) + end,
+                                     record);
+             end += RECORD_SIZE, recovered++) {
+            engine.updateRegister(record.begin);
+
+            if (record.kind == journal::Record::Kind::Purchase)
+                engine.registerTicket(record.registration, record.begin,
+                                      record.end);
+        }
+
+        munmap(mapping, size);
+
+        if (end < size && ftruncate(journalFile, end))
+            journalFailed();
+    }
+
+    lseek(journalFile, end, SEEK_SET);
+    journalClock = engine.currentTime();
+
+    if (recovered > 0) {
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::clog << "journal recovered " << recovered << " records in "
+                  << elapsed.count() << " ms\n";
+    }
+
+    journalWriter = std::thread(writeJournal);
+    return true;
+}
+
+void stopJournal() {
+    {
+        std::lock_guard lock(journalMutex);
+        journalClosing = true;
+    }
+
+    journalWake.notify_one();
+    journalWriter.join();
+    close(journalFile);
+}
+
+// Replication (--replicate SOCKET) to a hot standby, see standby.cc. A
+// follower that connects to the Unix socket SOCKET gets a checkpoint of the
+// tickets in the journal format right away, followed by the events as they
+// are applied; every query that moves the clock becomes a Clock record.
+// The records wait in a bounded buffer for a sender thread, so the verifier
+// never waits for the follower. A follower that falls more than
+// REPLICATION_BUFFER behind is disconnected, and catches up from a new
+// checkpoint when it connects again.
+//
+// The sender takes the checkpoint itself, between two lines: the main
+// thread holds engineMutex while it processes a line.
+constexpr size_t REPLICATION_BUFFER = 1 << 23;
+
+char const* replicationPath = nullptr;
+int replicationListener = -1;
+std::atomic<bool> replicaConnected{false};
+std::mutex engineMutex;
+// the rest is guarded by replicationMutex
+int replicaFd = -1;
+bool replicaDropped = false;
+bool replicationClosing = false;
+std::string replicationBuffer;
+size_t replicationLimit = REPLICATION_BUFFER;
+Time replicatedClock;
+std::mutex replicationMutex;
+std::condition_variable replicationReady;
+std::thread replicationSender;
+
+bool sendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent <= 0)
+            return false;
+
+        data.remove_prefix(sent);
+    }
+
+    return true;
+}
+
+// Holds engineMutex, if a follower may need a checkpoint of the engine.
+std::unique_lock<std::mutex> lockEngine() {
+    if (!replicationPath)
+        return {};
+
+    return std::unique_lock(engineMutex);
+}
+
+// Starts the replication buffer with a checkpoint of engine.
+template <typename Engine>
+void appendCheckpoint(Engine const& engine) {
+    using journal::Record;
+
+    replicationBuffer.assign(journal::JOURNAL_MAGIC);
+    replicatedClock = engine.currentTime();
+    journal::appendRecord(replicationBuffer,
+                          {Record::Kind::Clock, 0, 0, replicatedClock, {}});
+
+    for (auto [car, end] : engine.registeredCars()) {
+        journal::appendRecord(replicationBuffer,
+                              {Record::Kind::Purchase, 0, car,
+                               replicatedClock, end});
+    }
+
+    replicationLimit = replicationBuffer.size() + REPLICATION_BUFFER;
+}
+
+// Serves one follower after another.
+template <typename Engine>
+void sendReplication(Engine const& engine) {
+    std::string sending;
+
+    while (true) {
+        int fd = accept4(replicationListener, nullptr, nullptr, SOCK_CLOEXEC);
+
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED))
+            continue;
+
+        if (fd < 0)
+            return;
+
+        {
+            std::scoped_lock lock(engineMutex, replicationMutex);
+
+            // stopReplication would not see the follower
+            if (replicationClosing) {
+                close(fd);
+                return;
+            }
+
+            replicaFd = fd;
+            replicaDropped = false;
+            appendCheckpoint(engine);
+            replicaConnected.store(true);
+        }
+
+        while (true) {
+            {
+                std::unique_lock lock(replicationMutex);
+
+                replicationReady.wait(lock, [] {
+                    return replicationClosing || replicaDropped ||
+                           !replicationBuffer.empty();
+                });
+
+                if (replicaDropped || replicationBuffer.empty())
+                    break;
 
-constexpr std::string_view VALID_TIME =
-    R"-(((?:0?[89]|1[0-9])\.[0-5][0-9]|20\.00))-";
-constexpr std::string_view registration = R"-(([A-Z][A-Z0-9]{2,10}))-";
+                sending.swap(replicationBuffer);
+            }
 
-const std::string INPUT_LINE = "^\\s*" + std::string(registration) + "\\s+" +
-                               std::string(VALID_TIME) + "(?:\\s+" +
-                               std::string(VALID_TIME) + ")?\\s*$";
+            bool sent = sendAll(fd, sending);
+            sending.clear();
 
-Time readTime(std::string_view input) {
-    Time result;
-    std::from_chars(input.begin(), input.end(), result.first);
-    std::from_chars(input.end() - 2, input.end(), result.second);
-    return result;
-}
+            if (!sent)
+                break;
+        }
+
+        replicaConnected.store(false);
 
-bool operator<=(const Time& lhs, const Time& rhs) {
-    return timeToMinutes(lhs) <= timeToMinutes(rhs);
+        std::lock_guard lock(replicationMutex);
+        replicaFd = -1;
+        replicationBuffer.clear();
+        close(fd);
+
+        if (replicationClosing)
+            return;
+    }
 }
 
-bool ticketActive(Registration car) {
-    if (!registeredCars.contains(car))
+template <typename Engine>
+bool startReplication(Engine const& engine) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (std::string_view(replicationPath).size() >= sizeof(address.sun_path)) {
+        std::cerr << "socket path too long " << replicationPath << "\n";
         return false;
+    }
+
+    std::strcpy(address.sun_path, replicationPath);
+    unlink(replicationPath);
+    replicationListener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (replicationListener < 0 ||
+        bind(replicationListener, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) ||
+        listen(replicationListener, 1)) {
+        std::cerr << "cannot listen on " << replicationPath << "\n";
+        return false;
+    }
 
+    replicationSender = std::thread(sendReplication<Engine>, std::cref(engine));
     return true;
 }
 
-uint16_t duration(Time begin, Time end) {
-    if (begin <= end)
-        return timeToMinutes(end) - timeToMinutes(begin);
+void stopReplication() {
+    {
+        std::lock_guard lock(replicationMutex);
+        replicationClosing = true;
+    }
+
+    replicationReady.notify_one();
+    // wakes up the sender if it waits for a follower, or for a follower
+    // that stopped reading
+    shutdown(replicationListener, SHUT_RDWR);
+
+    {
+        std::lock_guard lock(replicationMutex);
 
-    return timeToMinutes(end) - timeToMinutes(OPENING_TIME)
-           - timeToMinutes(begin) + timeToMinutes(CLOSING_TIME);
+        if (replicaFd >= 0)
+            shutdown(replicaFd, SHUT_RDWR);
+    }
+
+    replicationSender.join();
+    close(replicationListener);
+    unlink(replicationPath);
 }
 
-uint16_t duration(TimeInterval interval) {
-    return duration(interval.first, interval.second);
+// Sends an event that the engine has admitted, before it is applied
+// (beyond moving the clock), to the follower if there is one.
+void replicateEvent(Event const& event, size_t lineId) {
+    using journal::Record;
+
+    if (!replicaConnected.load(std::memory_order_acquire))
+        return;
+
+    bool wasEmpty;
+
+    {
+        std::lock_guard lock(replicationMutex);
+
+        if (replicaFd < 0 || replicaDropped)
+            return;
+
+        wasEmpty = replicationBuffer.empty();
+
+        if (event.kind == Event::Kind::Purchase) {
+            journal::appendRecord(replicationBuffer,
+                                  {Record::Kind::Purchase, lineId,
+                                   event.registration, event.begin, event.end});
+        } else if (event.begin != replicatedClock) {
+            journal::appendRecord(replicationBuffer,
+                                  {Record::Kind::Clock, lineId,
+                                   event.registration, event.begin, {}});
+        }
+
+        replicatedClock = event.begin;
+
+        if (replicationBuffer.size() > replicationLimit) {
+            std::clog << "replica fell behind, disconnected\n";
+            replicaDropped = true;
+            replicationBuffer.clear();
+            shutdown(replicaFd, SHUT_RDWR);
+            replicaConnected.store(false);
+        }
+    }
+
+    if (wasEmpty)
+        replicationReady.notify_one();
 }
 
-bool checkTicketLength(Time begin, Time end) {
-    uint16_t paidTime = duration(begin, end);
+// Answers go straight to std::cout, except in concurrent mode, where the
+// answers of the readers and of the main thread are put back in the order
+// of the lines. Every line leaves its verdict in orderedVerdicts; whoever
+// leaves the verdict of the first line not taken yet takes it, with those
+// after it that are ready, into orderedAnswers, which is written in
+// batches under outputMutex.
+enum class Verdict : uint8_t { Pending, Error, Ok, Yes, No };
+
+constexpr std::array<std::string_view, 5> VERDICT_NAMES{"", "ERROR", "OK",
+                                                        "YES", "NO"};
+constexpr size_t ORDERED_LINES = 1 << 16;
 
-    return MINIMAL_PARKING_MINUTES <= paidTime &&
-           paidTime <= MAXIMAL_PARKING_MINUTES;
+std::unique_ptr<std::atomic<Verdict>[]> orderedVerdicts;
+std::atomic<size_t> nextOrderedLine{1};
+std::mutex outputMutex;
+std::string orderedAnswers;
+size_t answerBatchSize = 0;
+
+void flushAnswers() {
+    std::lock_guard lock(outputMutex);
+
+    std::cout.write(orderedAnswers.data(), orderedAnswers.size());
+    orderedAnswers.clear();
 }
 
-void registerTicket(Registration carRegistration, Time begin, Time end) {
-    auto ticket = registeredCars.find(carRegistration);
+// Takes the verdicts that are ready into orderedAnswers; called under
+// outputMutex.
+void takeVerdicts() {
+    size_t line = nextOrderedLine.load(std::memory_order_relaxed);
 
-    if (ticket != registeredCars.end()) {
-        Time oldTicketEnd = ticket->second;
+    for (Verdict verdict;
+         (verdict = orderedVerdicts[line % ORDERED_LINES].load()) !=
+         Verdict::Pending;) {
+        orderedVerdicts[line % ORDERED_LINES].store(Verdict::Pending,
+                                                    std::memory_order_relaxed);
 
-        // true if new ticket doesn't improve the old one
-        if ((oldTicketEnd > end && (oldTicketEnd < begin || begin <= end)) || 
-            (oldTicketEnd < begin && begin <= end)) {
-            return;
+        // ERROR goes to std::cerr
+        if (verdict != Verdict::Error) {
+            orderedAnswers.append(VERDICT_NAMES[size_t(verdict)]).append(" ");
+            orderedAnswers.append(std::to_string(line)).append("\n");
         }
 
-        tickets.erase({oldTicketEnd, carRegistration});
+        nextOrderedLine.store(++line);
     }
 
-    tickets.insert({end, carRegistration});
-    registeredCars[carRegistration] = end;
+    nextOrderedLine.notify_all();
 }
 
-void removeTicketsCont(TimeInterval inter) {
-    auto begin = tickets.lower_bound({inter.first, 0});
-    auto end = tickets.upper_bound({inter.second, 0});
+void putVerdict(Verdict verdict, size_t lineId) {
+    // the main thread may not get too far ahead of the slowest reader
+    for (size_t next; lineId - (next = nextOrderedLine.load(
+                                    std::memory_order_acquire)) >=
+                      ORDERED_LINES;)
+        nextOrderedLine.wait(next, std::memory_order_acquire);
 
-    std::for_each(begin, end, [&](std::pair<Time, Registration> r) {
-        registeredCars.erase(r.second);
-    });
-    tickets.erase(begin, end);
+    orderedVerdicts[lineId % ORDERED_LINES].store(verdict);
+
+    // the thread taking the line before sees the verdict otherwise
+    if (nextOrderedLine.load() != lineId)
+        return;
+
+    std::lock_guard lock(outputMutex);
+    takeVerdicts();
+
+    if (orderedAnswers.size() > answerBatchSize) {
+        std::cout.write(orderedAnswers.data(), orderedAnswers.size());
+        orderedAnswers.clear();
+    }
 }
 
-void updateRegister(Time oldTime, Time newTime) {
-    if (newTime < oldTime) {
-        removeTicketsCont({oldTime, AFTER_CLOSING_TIME});
-        removeTicketsCont({OPENING_TIME, newTime});
+// Writes an answer of the main thread, held back with --durable.
+void output(std::string_view text) {
+    if (durableAnswers) {
+        std::lock_guard lock(journalMutex);
+        pendingJournal.answers += text;
     } else {
-        removeTicketsCont({oldTime, newTime});
+        std::cout << text;
+    }
+}
+
+void answer(std::string_view verdict, size_t lineId) {
+    if (durableAnswers) {
+        output(std::string(verdict) + " " + std::to_string(lineId) + "\n");
+        return;
+    }
+
+    if (readerCount == 0) {
+        std::cout << verdict << " " << lineId << "\n";
+        return;
+    }
+
+    auto named = std::find(VERDICT_NAMES.begin(), VERDICT_NAMES.end(), verdict);
+    putVerdict(Verdict(named - VERDICT_NAMES.begin()), lineId);
+}
+
+void reportError(size_t lineId) {
+    std::cerr << "ERROR " << lineId << "\n";
+
+    if (readerCount > 0)
+        putVerdict(Verdict::Error, lineId);
+}
+
+// Answers a query for an inactive registration in fuzzy mode: MAYBE followed
+// by the active registrations it could have been misread from, or plain NO.
+void reportSimilarPlates(Registration registration, size_t lineId) {
+    std::vector<std::string> similar = similarActivePlates(registration);
+
+    if (similar.empty()) {
+        answer("NO", lineId);
+        return;
+    }
+
+    std::string line = "MAYBE " + std::to_string(lineId);
+
+    for (auto const& plate : similar)
+        line.append(" ").append(plate);
+
+    output(line + "\n");
+}
+
+// Workload capture (--capture FILE): every input line is recorded together
+// with its arrival time, so that the replay tool can reproduce the stream.
+std::ofstream captureFile;
+std::chrono::steady_clock::time_point lastArrival;
+
+void captureLine(std::string_view line) {
+    auto now = std::chrono::steady_clock::now();
+    auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        now - lastArrival);
+
+    lastArrival = now;
+    writeReplayRecord(captureFile, delay.count(), line);
+}
+
+std::vector<std::thread> readers;
+
+// Reader threads give the answers of sequential mode. What is taken into
+// orderedAnswers is written before they go idle.
+void answerQueries(QueryQueue& queue) {
+    QueryQueue::Query query;
+    uint32_t end, clock;
+
+    while (queue.next(query, flushAnswers)) {
+        Table const* table = concurrentTable.load(std::memory_order_acquire);
+        bool active = table->lookup(query.second, end, clock);
+
+        answer(active ? "YES" : "NO", query.first);
+        queue.answered();
+    }
+
+    flushAnswers();
+}
+
+void startReaders(RegisteredCars const& registeredCars) {
+    publishConcurrentTable(registeredCars, INITIAL_TABLE_BUCKETS);
+    orderedVerdicts = std::make_unique<std::atomic<Verdict>[]>(ORDERED_LINES);
+    lastQueries.assign(QUERY_SLOTS, 0);
+    // std::cout is written under outputMutex only, not on every read
+    std::cin.tie(nullptr);
+
+    for (size_t i = 0; i < readerCount; i++) {
+        queryQueues.push_back(std::make_unique<QueryQueue>());
+        readers.emplace_back(answerQueries, std::ref(*queryQueues.back()));
+    }
+}
+
+void stopReaders() {
+    for (auto& queue : queryQueues)
+        queue->close();
+
+    for (auto& reader : readers)
+        reader.join();
+
+    flushAnswers();
+}
+
+// Asynchronous I/O through io_uring (--io-uring). The standard streams keep
+// their formatting but get stream buffers that overlap reading and writing
+// with processing. std::cerr stays unbuffered, so ERROR lines are written
+// as they happen. Where io_uring is not available the standard buffers stay
+// in place.
+bool asynchronousIo = false;
+std::optional<uring_streams::InputBuffer> uringInput;
+std::optional<uring_streams::OutputBuffer> uringOutput;
+std::streambuf* standardBuffers[2];
+
+void startUring() {
+    try {
+        uringInput.emplace(STDIN_FILENO);
+        uringOutput.emplace(STDOUT_FILENO);
+    } catch (std::system_error const&) {
+        uringInput.reset();
+        uringOutput.reset();
+        return;
+    }
+
+    standardBuffers[0] = std::cin.rdbuf(&*uringInput);
+    standardBuffers[1] = std::cout.rdbuf(&*uringOutput);
+
+    // reading must not wait for the answers
+    std::cin.tie(nullptr);
+}
+
+void stopUring() {
+    if (!uringOutput)
+        return;
+
+    std::cout.flush();
+    std::cin.rdbuf(standardBuffers[0]);
+    std::cout.rdbuf(standardBuffers[1]);
+    uringInput.reset();
+    uringOutput.reset();
+}
+
+// Statistics printed at exit with --stats.
+bool printStatistics = false;
+
+void printStats() {
+    if (negativeFilter) {
+        size_t negativeQueries = filterNegatives + filterFalsePositives;
+
+        std::clog << "filter queries " << filterQueries << "\n"
+                  << "filter negatives " << filterNegatives << "\n"
+                  << "filter hit rate "
+                  << (filterQueries ? 1.0 * filterNegatives / filterQueries : 0)
+                  << "\n"
+                  << "filter false positives " << filterFalsePositives << "\n"
+                  << "filter false positive rate "
+                  << (negativeQueries ? 1.0 * filterFalsePositives
+                                            / negativeQueries : 0)
+                  << "\n"
+                  << "filter bytes " << activeFilter.memoryUsage() << "\n";
+    }
+
+    if (journalPath) {
+        std::clog << "journal syncs " << journalSyncs << "\n"
+                  << "journal records per sync "
+                  << (journalSyncs ? 1.0 * journalSyncedRecords / journalSyncs
+                                   : 0)
+                  << "\n";
+    }
+}
+
+// Latency of processing a line, from reading it to answering it, measured
+// on every Nth line with --latency N. Percentiles of the latencies are
+// printed every LATENCY_REPORT_INTERVAL and, for the whole run, at exit.
+constexpr std::chrono::seconds LATENCY_REPORT_INTERVAL{10};
+
+using latency_histogram::Histogram;
+using latency_histogram::TickClock;
+
+size_t latencySampling = 0;
+size_t linesToSample = 1;
+TickClock tickClock;
+Histogram recentLatencies, allLatencies;
+uint64_t nextLatencyReport = 0;
+
+void startLatencies() {
+    tickClock.start();
+    nextLatencyReport = TickClock::now() +
+                        tickClock.ticks(LATENCY_REPORT_INTERVAL);
+}
+
+// Returns when the processing of a line started, or 0 if its latency is
+// not measured.
+uint64_t lineStarted() {
+    if (latencySampling == 0 || --linesToSample > 0)
+        return 0;
+
+    linesToSample = latencySampling;
+    return TickClock::now();
+}
+
+void reportLatencies(std::string_view period, Histogram const& latencies) {
+    tickClock.calibrate();
+
+    auto nanoseconds = [](uint64_t ticks) {
+        return uint64_t(tickClock.nanoseconds(ticks));
+    };
+
+    std::clog << "latency " << period << " lines " << latencies.count();
+
+    for (auto [name, fraction] : {std::pair{"p50", 0.5}, {"p90", 0.9},
+                                  {"p99", 0.99}, {"p999", 0.999}})
+        std::clog << " " << name << " " << nanoseconds(latencies.valueAt(fraction));
+
+    std::clog << " max " << nanoseconds(latencies.max()) << " ns\n";
+}
+
+void lineFinished(uint64_t start) {
+    if (start == 0)
+        return;
+
+    uint64_t now = TickClock::now();
+
+    recentLatencies.record(now - start);
+
+    if (now >= nextLatencyReport) {
+        reportLatencies("recent", recentLatencies);
+        allLatencies.add(recentLatencies);
+        recentLatencies.reset();
+        nextLatencyReport = now + tickClock.ticks(LATENCY_REPORT_INTERVAL);
+    }
+}
+
+void stopLatencies() {
+    allLatencies.add(recentLatencies);
+    reportLatencies("total", allLatencies);
+}
+
+// Compaction after the evening drain. The containers keep the memory of
+// their busiest moment, so once less than a COMPACTION_FRACTION of the peak
+// number of tickets is left, they are rebuilt to fit and the freed memory is
+// given back to the system.
+constexpr size_t COMPACTION_FRACTION = 4;
+constexpr size_t MINIMAL_COMPACTION_PEAK = 1 << 12;
+constexpr size_t MINIMAL_FILTER_BUCKETS = 1 << 10;
+
+size_t peakTickets = 0;
+
+size_t residentKilobytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+template <typename Engine>
+void compactIfDrained(Engine& engine) {
+    RegisteredCars const& registeredCars = engine.registeredCars();
+
+    peakTickets = std::max(peakTickets, registeredCars.size());
+
+    if (peakTickets < MINIMAL_COMPACTION_PEAK ||
+        registeredCars.size() * COMPACTION_FRACTION >= peakTickets)
+        return;
+
+    size_t residentBefore = printStatistics ? residentKilobytes() : 0;
+
+    engine.compact();
+
+    if (fuzzyMatching)
+        PlateIndex(plateIndex.begin(), plateIndex.end()).swap(plateIndex);
+
+    if (negativeFilter) {
+        rebuildFilter(registeredCars,
+                      std::max(MINIMAL_FILTER_BUCKETS,
+                               std::bit_ceil(registeredCars.size() / 2)));
+    }
+
+    malloc_trim(0);
+
+    if (printStatistics) {
+        std::clog << "compacted " << peakTickets << " -> "
+                  << registeredCars.size() << " tickets, resident "
+                  << residentBefore << " kB -> " << residentKilobytes()
+                  << " kB\n";
+    }
+
+    peakTickets = registeredCars.size();
+}
+
+// Memory used for the tickets, printed on SIGUSR1 and at exit with --stats.
+// The containers count their memory themselves (see counting_allocator.h);
+// the heap as a whole is described by malloc.
+volatile std::sig_atomic_t memoryReportRequested = 0;
+size_t purchases = 0;
+
+void requestMemoryReport(int) {
+    memoryReportRequested = 1;
+}
+
+void printMemory(size_t ticketCount) {
+    using counting_allocator::Statistics;
+    using counting_allocator::statistics;
+
+    Statistics const& cars = statistics<RegisteredCarsMemory>();
+    Statistics const& tickets = statistics<TicketsMemory>();
+    size_t ticketBytes = cars.liveUsableBytes + tickets.liveUsableBytes;
+
+    auto printContainer = [](std::string_view name, Statistics const& memory) {
+        std::clog << "memory " << name << " allocations " << memory.allocations
+                  << " live " << memory.liveAllocations() << " bytes "
+                  << memory.liveBytes << " usable " << memory.liveUsableBytes
+                  << "\n";
+    };
+
+    printContainer("registeredCars", cars);
+    printContainer("tickets", tickets);
+
+    if (fuzzyMatching) {
+        printContainer("plateIndex", statistics<PlateIndexMemory>());
+        ticketBytes += statistics<PlateIndexMemory>().liveUsableBytes;
     }
+
+    if (negativeFilter)
+        ticketBytes += activeFilter.memoryUsage();
+
+    size_t requestedBytes = cars.liveBytes + tickets.liveBytes;
+    size_t usableBytes = cars.liveUsableBytes + tickets.liveUsableBytes;
+    struct mallinfo2 heap = mallinfo2();
+
+    std::clog << "memory live tickets " << ticketCount << " bytes per ticket "
+              << (ticketCount ? 1.0 * ticketBytes / ticketCount : 0) << "\n"
+              << "memory purchases " << purchases << " allocations per purchase "
+              << (purchases ? 1.0 * (cars.allocations + tickets.allocations)
+                                  / purchases : 0)
+              << "\n"
+              // malloc rounding up requests of the ticket containers
+              << "memory internal fragmentation "
+              << (usableBytes ? 1 - 1.0 * requestedBytes / usableBytes : 0)
+              << "\n"
+              // free memory between the used blocks of the heap, including
+              // what malloc_trim has given back to the system
+              << "memory heap " << heap.arena << " free " << heap.fordblks
+              << " external fragmentation "
+              << (heap.arena ? 1.0 * heap.fordblks / heap.arena : 0) << "\n"
+              << "memory resident " << residentKilobytes() << " kB\n";
 }
 
-// Encodes registration as a 64 bit number 
-// by treating it as a numbering system with base 37.
-// Encoding assigns
-// - empty space to 0
-// - digits 0-9 to digits 1-10
-// - letters A-Z to digits 11-36
-Registration registrationFromString(std::string_view s) {
-    Registration out = 0;
+constexpr std::string_view USAGE =
+    " [--fuzzy] [--capture FILE] [--line-buffered] [--readers N]"
+    " [--filter] [--stats] [--shm NAME [--shm-buckets N]] [--io-uring]"
+    " [--rules NAME] [--parallel-parse THREADS] [--expired FILE]"
+    " [--latency N] [--seconds]"
+    " [--journal FILE [--journal-batch N] [--journal-delay MS] [--durable]]"
+    " [--replicate SOCKET] [--import FILE]";
+std::string_view rulesName = DefaultRules::name;
+char const* importPath = nullptr;
+// threads parsing a regular file on standard input, 0 to read it line by line
+size_t parseThreads = 0;
+constexpr size_t ANSWER_BATCH_SIZE = 1 << 16;
 
-    for (size_t i = 0; i < 11; i++) {
-        if (s.length() > i && s[i] < '9') {
-            out += s[i] - '0' + 1;
-        } else if (s.length() > i) {
-            out += s[i] - 'A' + 11;
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string_view option(argv[i]);
+
+        if (option == "--fuzzy") {
+            fuzzyMatching = true;
+        } else if (option == "--capture" && i + 1 < argc) {
+            captureFile.open(argv[++i], std::ios::binary);
+
+            if (!captureFile) {
+                std::cerr << "cannot open " << argv[i] << "\n";
+                return false;
+            }
+
+            captureFile << REPLAY_MAGIC;
+            lastArrival = std::chrono::steady_clock::now();
+        } else if (option == "--line-buffered") {
+            // lets a driver see every answer as soon as it is produced
+            std::cout << std::unitbuf;
+            answerBatchSize = 0;
+            expiryDelay = {};
+        } else if (option == "--filter") {
+            negativeFilter = true;
+        } else if (option == "--stats") {
+            printStatistics = true;
+        } else if (option == "--rules" && i + 1 < argc) {
+            rulesName = argv[++i];
+        } else if (option == "--io-uring") {
+            asynchronousIo = true;
+        } else if (option == "--shm" && i + 1 < argc) {
+            sharedName = argv[++i];
+        } else if (option == "--shm-buckets" && i + 1 < argc) {
+            sharedBuckets = std::bit_ceil(std::stoul(argv[++i]));
+        } else if (option == "--expired" && i + 1 < argc) {
+            expiryFile = open(argv[++i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                              0644);
+
+            if (expiryFile < 0) {
+                std::cerr << "cannot open " << argv[i] << "\n";
+                return false;
+            }
+        } else if (option == "--journal" && i + 1 < argc) {
+            journalPath = argv[++i];
+        } else if (option == "--journal-batch" && i + 1 < argc) {
+            journalBatch = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--journal-delay" && i + 1 < argc) {
+            journalDelay = std::chrono::milliseconds(std::stoul(argv[++i]));
+        } else if (option == "--replicate" && i + 1 < argc) {
+            replicationPath = argv[++i];
+        } else if (option == "--import" && i + 1 < argc) {
+            importPath = argv[++i];
+        } else if (option == "--durable") {
+            durableAnswers = true;
+        } else if (option == "--seconds") {
+            secondsResolution = true;
+        } else if (option == "--latency" && i + 1 < argc) {
+            latencySampling = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--parallel-parse" && i + 1 < argc) {
+            parseThreads = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--readers" && i + 1 < argc) {
+            readerCount = std::stoul(argv[++i]);
+
+            if (std::cout.flags() & std::ios::unitbuf)
+                answerBatchSize = 0;
+            else
+                answerBatchSize = ANSWER_BATCH_SIZE;
+        } else {
+            std::cerr << "usage: " << argv[0] << USAGE << "\n";
+            return false;
         }
+    }
+
+    if (readerCount > 0 && fuzzyMatching) {
+        std::cerr << "--fuzzy cannot be used with --readers\n";
+        return false;
+    }
+
+    if (durableAnswers && (!journalPath || readerCount > 0)) {
+        std::cerr << "--durable needs --journal and cannot be used with "
+                     "--readers\n";
+        return false;
+    }
+
+#ifdef PARKING_WIDE_PLATES
+    // the concurrent and the shared tables have 64 bit keys
+    if (readerCount > 0 || !sharedName.empty()) {
+        std::cerr << "--readers and --shm cannot be used with wide plates\n";
+        return false;
+    }
+#endif
+
+    if (parseThreads > 0 && captureFile.is_open()) {
+        std::cerr << "--capture cannot be used with --parallel-parse\n";
+        return false;
+    }
+
+    return true;
+}
 
-        out *= 37;
+// Answers an event that the engine has admitted.
+template <typename Engine>
+void respond(Engine& engine, Event const& event, size_t lineId) {
+    compactIfDrained(engine);
+
+    if (memoryReportRequested) {
+        memoryReportRequested = 0;
+        printMemory(engine.registeredCars().size());
     }
 
-    return out;
+    if (journalFile >= 0)
+        journalEvent(event, lineId);
+
+    if (replicationPath)
+        replicateEvent(event, lineId);
+
+    if (event.kind == Event::Kind::Purchase) {
+        engine.registerTicket(event.registration, event.begin, event.end);
+        purchases++;
+        answer("OK", lineId);
+    } else if (readerCount > 0) {
+        handOverQuery(event.registration, lineId);
+    } else if (ticketActive(engine, event.registration)) {
+        answer("YES", lineId);
+    } else if (fuzzyMatching) {
+        reportSimilarPlates(event.registration, lineId);
+    } else {
+        answer("NO", lineId);
+    }
 }
 
-int main() {
+template <typename Engine>
+void processStream(Engine& engine) {
     std::string line;
     size_t lineId = 0;
-    Time prevTime{8, 0};
-    std::smatch match;
-    std::regex lineRegex(INPUT_LINE, std::regex_constants::optimize | 
-                         std::regex_constants::ECMAScript);
+    LineParser parser(secondsResolution);
 
     while (std::getline(std::cin, line)) {
         lineId++;
 
-        if (!std::regex_match(line, match, lineRegex)) {
-            std::cerr << "ERROR " << lineId << "\n";
-            continue;
-        }
+        if (captureFile.is_open())
+            captureLine(line);
 
-        Registration registration = registrationFromString(
-            std::string_view(match[1].first, match[1].second));
-        Time endTime, newTime = readTime(std::string_view(match[2].first, 
-                                                          match[2].second));
+        uint64_t start = lineStarted();
+        Event event = parser.parse(line);
+        auto engineLock = lockEngine();
 
-        // ticket registration detection
-        if (match[3].matched) {
-            endTime = readTime(std::string_view(
-                match[3].first, match[3].second));
+        if (engine.admit(event))
+            respond(engine, event, lineId);
+        else
+            reportError(lineId);
 
-            if (!checkTicketLength(newTime, endTime)) {
-                std::cerr << "ERROR " << lineId << "\n";
-                continue;
-            }
+        lineFinished(start);
+    }
+}
+
+// Parses the lines of input into events, marking those that are not valid
+// under the rules of engine as Invalid.
+template <typename Engine>
+std::vector<Event> parseChunk(Engine const& engine, std::string_view input) {
+    std::vector<Event> events;
+    LineParser parser(secondsResolution);
+
+    // a line per 24 bytes is about what recorded days look like
+    events.reserve(input.size() / 24 + 1);
+
+    while (!input.empty()) {
+        size_t end = std::min(input.find('\n'), input.size());
+        Event event = parser.parse(input.substr(0, end));
+
+        if (!engine.valid(event))
+            event.kind = Event::Kind::Invalid;
+
+        events.push_back(event);
+        input.remove_prefix(std::min(end + 1, input.size()));
+    }
+
+    return events;
+}
+
+// Processes standard input in two phases when it is a regular file. The
+// file is mapped into memory, split at line boundaries into a chunk per
+// thread and the chunks are parsed and checked in parallel; the events are
+// then applied to the engine in one sequential pass. Returns false, having
+// read nothing, when standard input cannot be mapped.
+template <typename Engine>
+bool processMapped(Engine& engine) {
+    struct stat status;
+    off_t position = lseek(STDIN_FILENO, 0, SEEK_CUR);
+
+    if (fstat(STDIN_FILENO, &status) || !S_ISREG(status.st_mode) ||
+        position < 0)
+        return false;
+
+    size_t size = status.st_size > position ? status.st_size - position : 0;
+    std::vector<std::vector<Event>> chunks(parseThreads);
+
+    if (size > 0) {
+        void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE,
+                             STDIN_FILENO, 0);
+
+        if (mapping == MAP_FAILED)
+            return false;
+
+        madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+        std::string_view input(static_cast<char const*>(mapping) + position,
+                               size);
+        std::vector<std::thread> parsers;
+        size_t begin = 0;
+
+        for (size_t i = 0; i < parseThreads; i++) {
+            size_t end = std::max(begin, size / parseThreads * (i + 1));
+
+            // a chunk ends just after a newline
+            end = i + 1 == parseThreads
+                      ? size
+                      : std::min(input.find('\n', end), size - 1) + 1;
+            parsers.emplace_back([&, i, begin, end] {
+                chunks[i] = parseChunk(engine, input.substr(begin, end - begin));
+            });
+            begin = end;
         }
 
-        if (prevTime != newTime)
-            updateRegister(prevTime, newTime);
+        for (auto& parser : parsers)
+            parser.join();
 
-        prevTime = newTime;
+        munmap(mapping, status.st_size);
+        lseek(STDIN_FILENO, status.st_size, SEEK_SET);
+    }
 
-        // ticket registration detection
-        if (match[3].matched) {
-            registerTicket(registration, newTime, endTime);
-            std::cout << "OK " << lineId << "\n";
-        } else {
-            if (ticketActive(registration)) {
-                std::cout << "YES " << lineId << "\n";
+    size_t lineId = 0;
+
+    for (auto& events : chunks) {
+        for (Event const& event : events) {
+            lineId++;
+            uint64_t start = lineStarted();
+
+            if (event.kind == Event::Kind::Invalid) {
+                reportError(lineId);
             } else {
-                std::cout << "NO " << lineId << "\n";
+                auto engineLock = lockEngine();
+                engine.updateRegister(event.begin);
+                respond(engine, event, lineId);
             }
 
-            continue;
+            lineFinished(start);
         }
+
+        // the events are not needed any more
+        std::vector<Event>().swap(events);
+    }
+
+    return true;
+}
+
+// Reconciliation file (--import FILE) of purchases, "<registration> <begin>
+// <end>" lines sorted by begin as payment providers send them. The file is
+// applied in bulk before standard input, with the same result as if its
+// lines came first there, but without answers. It has to be applied before
+// a follower can connect, as the records replicated for it would be sent
+// after the checkpoint that already holds them.
+
+template <typename Engine>
+bool importPurchases(Engine& engine) {
+    std::ifstream file(importPath);
+
+    if (!file) {
+        std::cerr << "cannot open " << importPath << "\n";
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Event> batch;
+    LineParser parser(secondsResolution);
+    std::string line;
+
+    while (std::getline(file, line))
+        batch.push_back(parser.parse(line));
+
+    if (!engine.importTickets(batch)) {
+        std::cerr << "cannot import " << importPath
+                  << ": not valid purchases sorted by begin\n";
+        return false;
+    }
+
+    if (journalFile >= 0) {
+        for (Event const& event : batch)
+            journalEvent(event, 0);
+    }
+
+    purchases += batch.size();
+
+    if (printStatistics) {
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::clog << "imported " << batch.size() << " purchases in "
+                  << elapsed.count() << " ms\n";
+    }
+
+    return true;
+}
+
+// Verifies the input with tariff rules fixed at compile time.
+template <StaticParkingRules Rules>
+int run() {
+    Engine<Rules, MirrorHooks> engine;
+
+    if (readerCount > 0)
+        startReaders(engine.registeredCars());
+
+    if (!sharedName.empty() &&
+        !publishSharedTable(engine.registeredCars(), sharedBuckets))
+        return 1;
+
+    if (journalPath && !recoverJournal(engine))
+        return 1;
+
+    notifyingExpiries = expiryFile >= 0;
+
+    if (importPath && !importPurchases(engine))
+        return 1;
+
+    if (replicationPath && !startReplication(engine))
+        return 1;
+
+    if (expiryFile >= 0)
+        startExpiries();
+
+    if (latencySampling > 0)
+        startLatencies();
+
+    signal(SIGUSR1, requestMemoryReport);
+
+    if (parseThreads == 0 || !processMapped(engine))
+        processStream(engine);
+
+    if (readerCount > 0)
+        stopReaders();
+
+    stopSharing();
+
+    if (journalFile >= 0)
+        stopJournal();
+
+    if (replicationPath)
+        stopReplication();
+
+    if (expiryFile >= 0)
+        stopExpiries();
+
+    if (latencySampling > 0)
+        stopLatencies();
+
+    if (printStatistics) {
+        printStats();
+        printMemory(engine.registeredCars().size());
+    }
+
+    return 0;
+}
+
+// fuzz_parking.cc includes this file and calls run() itself
+#ifndef PARKING_NO_MAIN
+// Rules this binary is built with, selected by --rules NAME.
+constexpr std::array RULES{
+    std::pair{DefaultRules::name, &run<DefaultRules>},
+    std::pair{ExtendedHoursRules::name, &run<ExtendedHoursRules>},
+    std::pair{ShortStayRules::name, &run<ShortStayRules>},
+};
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv))
+        return 1;
+
+    auto rules = std::find_if(RULES.begin(), RULES.end(), [](auto const& r) {
+        return r.first == rulesName;
+    });
+
+    if (rules == RULES.end()) {
+        std::cerr << "unknown rules " << rulesName << "\n";
+        return 1;
     }
+
+    if (asynchronousIo)
+        startUring();
+
+    int status = rules->second();
+
+    stopUring();
+    return status;
 }
+#endif
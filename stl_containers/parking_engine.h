@@ -0,0 +1,422 @@
+#ifndef PARKING_ENGINE_H
+#define PARKING_ENGINE_H
+
+// State of paid parking: which cars have active tickets and until when.
+//
+// The engine is a template over the tariff rules of a municipality, so that
+// every set of rules gets its own code with the rules constant-folded into
+// it, and over hooks through which the verifier keeps its secondary
+// structures in sync with registeredCars.
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "counting_allocator.h"
+#include "registration.h"
+
+// Time of day packed into the number of seconds after midnight, so that
+// times compare and subtract as plain integers.
+class Time {
+public:
+    constexpr Time() = default;
+
+    constexpr Time(uint32_t hours, uint32_t minutes, uint32_t seconds = 0)
+        : packed(3600 * hours + 60 * minutes + seconds) {}
+
+    static constexpr Time fromSeconds(uint32_t seconds) {
+        Time time;
+        time.packed = seconds;
+        return time;
+    }
+
+    constexpr uint32_t hours() const noexcept {
+        return packed / 3600;
+    }
+
+    constexpr uint32_t minutes() const noexcept {
+        return packed / 60 % 60;
+    }
+
+    constexpr uint32_t seconds() const noexcept {
+        return packed % 60;
+    }
+
+    constexpr uint32_t secondsAfterMidnight() const noexcept {
+        return packed;
+    }
+
+    friend constexpr auto operator<=>(Time, Time) = default;
+
+private:
+    uint32_t packed = 0;
+};
+
+// tags under which the memory of the containers is counted
+struct RegisteredCarsMemory {};
+struct TicketsMemory {};
+
+using TimeInterval = std::pair<Time, Time>;
+using RegisteredCars = std::unordered_map<
+    Registration, Time, RegistrationHash, std::equal_to<Registration>,
+    counting_allocator::Allocator<std::pair<Registration const, Time>,
+                                  RegisteredCarsMemory>>;
+using Tickets = std::set<
+    std::pair<Time, Registration>, std::less<std::pair<Time, Registration>>,
+    counting_allocator::Allocator<std::pair<Time, Registration>,
+                                  TicketsMemory>>;
+
+constexpr uint16_t timeToMinutes(Time time) {
+    return time.secondsAfterMidnight() / 60;
+}
+
+constexpr uint32_t timeToSeconds(Time time) {
+    return time.secondsAfterMidnight();
+}
+
+// Tariff rules: paid parking lasts from openingTime to closingTime every
+// day, and a ticket is valid for minimalParkingMinutes to
+// maximalParkingMinutes of paid time. A ticket must be shorter than a day.
+template <typename Rules>
+concept ParkingRules = requires(Rules const rules) {
+    { rules.openingTime } -> std::convertible_to<Time>;
+    { rules.closingTime } -> std::convertible_to<Time>;
+    { rules.minimalParkingMinutes } -> std::convertible_to<uint16_t>;
+    { rules.maximalParkingMinutes } -> std::convertible_to<uint16_t>;
+};
+
+template <typename Rules>
+concept StaticParkingRules =
+    ParkingRules<Rules> &&
+    Rules::maximalParkingMinutes < timeToMinutes(Rules::closingTime) -
+                                   timeToMinutes(Rules::openingTime);
+
+struct DefaultRules {
+    static constexpr std::string_view name = "default";
+    static constexpr Time openingTime{8, 0};
+    static constexpr Time closingTime{20, 0};
+    static constexpr uint16_t minimalParkingMinutes = timeToMinutes(Time{0, 10});
+    static constexpr uint16_t maximalParkingMinutes = timeToMinutes(Time{11, 59});
+};
+
+struct ExtendedHoursRules {
+    static constexpr std::string_view name = "extended";
+    static constexpr Time openingTime{7, 0};
+    static constexpr Time closingTime{22, 0};
+    static constexpr uint16_t minimalParkingMinutes = timeToMinutes(Time{0, 15});
+    static constexpr uint16_t maximalParkingMinutes = timeToMinutes(Time{14, 59});
+};
+
+struct ShortStayRules {
+    static constexpr std::string_view name = "short-stay";
+    static constexpr Time openingTime{9, 0};
+    static constexpr Time closingTime{18, 0};
+    static constexpr uint16_t minimalParkingMinutes = timeToMinutes(Time{0, 10});
+    static constexpr uint16_t maximalParkingMinutes = timeToMinutes(Time{2, 0});
+};
+
+// Rules chosen at run time, e.g. to simulate proposed changes.
+struct RuntimeRules {
+    Time openingTime;
+    Time closingTime;
+    uint16_t minimalParkingMinutes;
+    uint16_t maximalParkingMinutes;
+};
+
+static_assert(ParkingRules<RuntimeRules>);
+static_assert(StaticParkingRules<DefaultRules>);
+static_assert(StaticParkingRules<ExtendedHoursRules>);
+static_assert(StaticParkingRules<ShortStayRules>);
+
+// An input line: a purchase "<registration> <begin> <end>" or a query
+// "<registration> <current time>", which has no end. Lines of another
+// shape are Invalid.
+struct Event {
+    enum class Kind : uint8_t { Invalid, Query, Purchase };
+
+    Kind kind = Kind::Invalid;
+    Registration registration = 0;
+    Time begin{};
+    Time end{};
+};
+
+// Hooks of an engine that has nothing to keep in sync.
+struct NoHooks {
+    void ticketStored(RegisteredCars const&, Registration, Time, bool) const {}
+    void ticketRemoved(Registration, Time) const {}
+    void clockMoving() const {}
+    void clockMoved(Time) const {}
+};
+
+template <ParkingRules Rules, typename Hooks = NoHooks>
+class Engine {
+public:
+    explicit Engine(Rules rules = {}, Hooks hooks = {})
+        : rules(rules), hooks(hooks), clock(rules.openingTime) {}
+
+    RegisteredCars const& registeredCars() const noexcept {
+        return cars;
+    }
+
+    Time currentTime() const noexcept {
+        return clock;
+    }
+
+    bool validTime(Time time) const {
+        return rules.openingTime <= time && time <= rules.closingTime;
+    }
+
+    // Paid time between begin and end, in seconds.
+    uint32_t duration(Time begin, Time end) const {
+        if (begin <= end)
+            return timeToSeconds(end) - timeToSeconds(begin);
+
+        return timeToSeconds(end) - timeToSeconds(rules.openingTime)
+               - timeToSeconds(begin) + timeToSeconds(rules.closingTime);
+    }
+
+    uint32_t duration(TimeInterval interval) const {
+        return duration(interval.first, interval.second);
+    }
+
+    bool checkTicketLength(Time begin, Time end) const {
+        uint32_t paidTime = duration(begin, end);
+
+        return 60u * rules.minimalParkingMinutes <= paidTime &&
+               paidTime <= 60u * rules.maximalParkingMinutes;
+    }
+
+    // Checks the times of event against the rules. This does not depend on
+    // the state, so events may be checked ahead of applying them.
+    bool valid(Event const& event) const {
+        if (event.kind == Event::Kind::Invalid || !validTime(event.begin))
+            return false;
+
+        return event.kind != Event::Kind::Purchase ||
+               (validTime(event.end) && checkTicketLength(event.begin, event.end));
+    }
+
+    // Checks the times of event against the rules and, if they are valid,
+    // moves the clock to the time of event. An ERROR is due otherwise.
+    bool admit(Event const& event) {
+        if (!valid(event))
+            return false;
+
+        updateRegister(event.begin);
+        return true;
+    }
+
+    bool ticketActive(Registration car) const {
+        return cars.contains(car);
+    }
+
+    void registerTicket(Registration carRegistration, Time begin, Time end) {
+        auto ticket = cars.find(carRegistration);
+
+        if (ticket != cars.end()) {
+            Time oldTicketEnd = ticket->second;
+
+            if (!improves(oldTicketEnd, begin, end))
+                return;
+
+            tickets.erase({oldTicketEnd, carRegistration});
+        }
+
+        bool newCar = ticket == cars.end();
+
+        tickets.insert({end, carRegistration});
+        cars[carRegistration] = end;
+        hooks.ticketStored(cars, carRegistration, end, newCar);
+    }
+
+    // Moves the clock to newTime, which is on the next day if it is
+    // earlier than the current time, and forgets tickets that expired.
+    void updateRegister(Time newTime) {
+        if (newTime == clock)
+            return;
+
+        hooks.clockMoving();
+
+        if (newTime < clock) {
+            removeTicketsCont({clock, afterClosingTime()});
+            removeTicketsCont({rules.openingTime, newTime});
+        } else {
+            removeTicketsCont({clock, newTime});
+        }
+
+        clock = newTime;
+        hooks.clockMoved(newTime);
+    }
+
+    // Applies a batch of purchases sorted by begin, e.g. a reconciliation
+    // file of a payment provider, with the same result as admitting and
+    // registering them one by one, hooks included; only tickets that are
+    // bought and expire within the batch are reported once the clock has
+    // moved, as no ticket may be stored while it moves. Rather than
+    // updating both containers for every purchase, the tickets of every
+    // plate are resolved within the batch first, and the tickets left are
+    // merged into the expiry index in one pass. Returns false, changing
+    // nothing, if an event is not a valid purchase or the batch is not
+    // sorted.
+    bool importTickets(std::span<Event const> batch) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch[i].kind != Event::Kind::Purchase || !valid(batch[i]) ||
+                (i > 0 && batch[i].begin < batch[i - 1].begin))
+                return false;
+        }
+
+        if (batch.empty())
+            return true;
+
+        Time last = batch.back().begin;
+        // the clock moves to the next day at the first purchase
+        bool wraps = batch.front().begin < clock;
+
+        struct Plate {
+            Time begin;
+            Time end;
+            bool active = false;
+            // bought within the batch rather than before it
+            bool imported = false;
+            // the ticket from before the batch was replaced, not expired
+            bool replacedOld = false;
+        };
+
+        // true if the ticket of plate has expired when the clock gets to now
+        auto expired = [&](Plate const& plate, Time now) {
+            if (plate.imported)
+                return plate.begin <= plate.end && plate.end < now;
+
+            return wraps ? clock <= plate.end || plate.end < now
+                         : clock <= plate.end && plate.end < now;
+        };
+
+        std::unordered_map<Registration, Plate, RegistrationHash> plates;
+        std::vector<std::pair<Time, Registration>> expiredImports, stored;
+
+        plates.reserve(batch.size());
+
+        for (Event const& event : batch) {
+            auto [entry, added] = plates.try_emplace(event.registration);
+            Plate& plate = entry->second;
+
+            if (added) {
+                auto ticket = cars.find(event.registration);
+                plate.active = ticket != cars.end();
+
+                if (plate.active)
+                    plate.end = ticket->second;
+            }
+
+            if (plate.active && expired(plate, event.begin)) {
+                if (plate.imported)
+                    expiredImports.push_back({plate.end, event.registration});
+
+                plate.active = false;
+            }
+
+            if (plate.active && !improves(plate.end, event.begin, event.end))
+                continue;
+
+            plate.replacedOld |= plate.active && !plate.imported;
+            plate = {event.begin, event.end, true, true, plate.replacedOld};
+        }
+
+        for (auto const& [car, plate] : plates) {
+            // cars still holds the end of the replaced ticket
+            if (plate.replacedOld)
+                tickets.erase({cars.find(car)->second, car});
+
+            if (plate.active && plate.imported)
+                (expired(plate, last) ? expiredImports : stored)
+                    .push_back({plate.end, car});
+        }
+
+        std::sort(expiredImports.begin(), expiredImports.end());
+        std::sort(stored.begin(), stored.end());
+
+        // tickets bought within the batch expire only as the clock moves
+        if (wraps || last != clock) {
+            hooks.clockMoving();
+
+            if (wraps) {
+                removeTicketsCont({clock, afterClosingTime()});
+                removeTicketsCont({rules.openingTime, last});
+            } else {
+                removeTicketsCont({clock, last});
+            }
+
+            clock = last;
+            hooks.clockMoved(last);
+        }
+
+        // a ticket from before the batch that expired did so before any
+        // ticket of its plate bought within the batch
+        for (auto [end, car] : expiredImports) {
+            hooks.ticketStored(cars, car, end, !cars.contains(car));
+            cars.erase(car);
+            hooks.ticketRemoved(car, end);
+        }
+
+        cars.reserve(cars.size() + stored.size());
+        auto position = tickets.begin();
+
+        for (auto ticket : stored) {
+            while (position != tickets.end() && *position < ticket)
+                ++position;
+
+            position = std::next(tickets.emplace_hint(position, ticket));
+
+            bool newCar = cars.insert_or_assign(ticket.second, ticket.first).second;
+            hooks.ticketStored(cars, ticket.second, ticket.first, newCar);
+        }
+
+        return true;
+    }
+
+    // Rebuilds the containers to fit the tickets that are left. This gives
+    // back the memory of expired tickets and puts the nodes of the expiry
+    // index next to each other in order.
+    void compact() {
+        RegisteredCars(cars.begin(), cars.end()).swap(cars);
+        Tickets(tickets.begin(), tickets.end()).swap(tickets);
+    }
+
+private:
+    [[no_unique_address]] Rules rules;
+    [[no_unique_address]] Hooks hooks;
+    RegisteredCars cars{};
+    Tickets tickets{};
+    Time clock;
+
+    // true if a ticket from begin to end is worth more than one that ends
+    // at oldEnd
+    static bool improves(Time oldEnd, Time begin, Time end) {
+        return !((oldEnd > end && (oldEnd < begin || begin <= end)) ||
+                 (oldEnd < begin && begin <= end));
+    }
+
+    Time afterClosingTime() const {
+        return Time::fromSeconds(timeToSeconds(rules.closingTime) + 1);
+    }
+
+    void removeTicketsCont(TimeInterval inter) {
+        auto begin = tickets.lower_bound({inter.first, 0});
+        auto end = tickets.upper_bound({inter.second, 0});
+
+        std::for_each(begin, end, [&](std::pair<Time, Registration> r) {
+            cars.erase(r.second);
+            hooks.ticketRemoved(r.second, r.first);
+        });
+        tickets.erase(begin, end);
+    }
+};
+
+#endif  // PARKING_ENGINE_H
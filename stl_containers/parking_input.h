@@ -0,0 +1,103 @@
+#ifndef PARKING_INPUT_H
+#define PARKING_INPUT_H
+
+// Parsing of the verifier's input lines into events for the engine.
+
+#include <charconv>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <string_view>
+
+#include "parking_engine.h"
+#include "registration.h"
+
+// whether a time falls within paid hours depends on the rules
+constexpr std::string_view VALID_TIME = R"-(([0-9]{1,2}\.[0-5][0-9]))-";
+// HH.MM or, with seconds resolution, also HH.MM.SS
+constexpr std::string_view VALID_PRECISE_TIME =
+    R"-(([0-9]{1,2}\.[0-5][0-9](?:\.[0-5][0-9])?))-";
+#ifdef PARKING_WIDE_PLATES
+constexpr std::string_view registration = R"-(([A-Z][A-Z0-9]{2,15}))-";
+#else
+constexpr std::string_view registration = R"-(([A-Z][A-Z0-9]{2,10}))-";
+#endif
+
+inline std::string inputLine(std::string_view time) {
+    return "^\\s*" + std::string(registration) + "\\s+" + std::string(time) +
+           "(?:\\s+" + std::string(time) + ")?\\s*$";
+}
+
+inline const std::string INPUT_LINE = inputLine(VALID_TIME);
+
+// Reads a time matched by VALID_TIME or VALID_PRECISE_TIME.
+inline Time readTime(std::string_view input) {
+    uint32_t hours = 0, minutes = 0, seconds = 0;
+    size_t dot = input.find('.');
+
+    std::from_chars(input.data(), input.data() + dot, hours);
+    std::from_chars(input.data() + dot + 1, input.data() + dot + 3, minutes);
+
+    if (input.size() > dot + 3)
+        std::from_chars(input.data() + dot + 4, input.data() + dot + 6, seconds);
+
+    return Time{hours, minutes, seconds};
+}
+
+// Writes time as H.MM, or as H.MM.SS when withSeconds is set.
+inline std::string timeToString(Time time, bool withSeconds = false) {
+    std::string result = std::to_string(time.hours());
+
+    auto appendTwoDigits = [&](uint32_t value) {
+        result += '.';
+        result += char('0' + value / 10);
+        result += char('0' + value % 10);
+    };
+
+    appendTwoDigits(time.minutes());
+
+    if (withSeconds)
+        appendTwoDigits(time.seconds());
+
+    return result;
+}
+
+class LineParser {
+public:
+    // With withSeconds, times may also be given to the second.
+    explicit LineParser(bool withSeconds = false)
+        : lineRegex(withSeconds ? inputLine(VALID_PRECISE_TIME) : INPUT_LINE,
+                    std::regex_constants::optimize |
+                        std::regex_constants::ECMAScript) {}
+
+    // Safe to call from many threads at once.
+    Event parse(std::string_view line) const {
+        std::cmatch match;
+        Event event;
+
+        if (!std::regex_match(line.data(), line.data() + line.size(), match,
+                              lineRegex))
+            return event;
+
+        event.registration = registrationFromString(
+            std::string_view(match[1].first, match[1].second));
+        event.begin = readTime(std::string_view(match[2].first,
+                                                match[2].second));
+
+        // ticket registration detection
+        if (match[3].matched) {
+            event.kind = Event::Kind::Purchase;
+            event.end = readTime(std::string_view(match[3].first,
+                                                  match[3].second));
+        } else {
+            event.kind = Event::Kind::Query;
+        }
+
+        return event;
+    }
+
+private:
+    std::regex lineRegex;
+};
+
+#endif  // PARKING_INPUT_H
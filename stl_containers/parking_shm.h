@@ -0,0 +1,184 @@
+#ifndef PARKING_SHM_H
+#define PARKING_SHM_H
+
+// Ticket table exported by `parking --shm NAME` to POSIX shared memory, and
+// a read-only client for other processes on the same host.
+//
+// The segment starts with a Header followed by a seqlock_table::Table from
+// registrations to the ends of their active tickets, in seconds after
+// midnight. A client looks tickets up directly in the mapped memory, without
+// any communication with the verifier.
+//
+// The verifier never resizes a segment. When the table fills up, it unlinks
+// the name, publishes a bigger segment under it and marks the old one as
+// retired; a client notices that on its next lookup and maps the new one.
+// Until the new segment is complete a client finds no segment, or one
+// without a version, and waits for up to PUBLISHING_TIMEOUT.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "registration.h"
+#include "seqlock_table.h"
+
+namespace parking_shm {
+
+constexpr uint64_t MAGIC = 0x314d48534b524150ULL;  // "PARKSHM1"
+constexpr uint32_t LAYOUT_VERSION = 2;
+constexpr std::chrono::seconds PUBLISHING_TIMEOUT{1};
+constexpr std::chrono::milliseconds PUBLISHING_POLL{1};
+
+struct alignas(64) Header {
+    uint64_t magic;
+    // written last, once the rest of the segment is ready
+    std::atomic<uint32_t> version;
+    uint32_t bucketCount;
+    // set once a newer segment has been published under the same name
+    std::atomic<uint32_t> retired;
+};
+
+constexpr size_t segmentSize(uint32_t bucketCount) {
+    return sizeof(Header) + seqlock_table::Table::regionSize(bucketCount);
+}
+
+inline bool validRegistration(std::string_view plate) {
+    auto allowed = [](char c) {
+        return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    };
+
+    return plate.length() >= 3 &&
+           plate.length() <= MAXIMAL_REGISTRATION_LENGTH &&
+           plate[0] >= 'A' && plate[0] <= 'Z' &&
+           std::all_of(plate.begin(), plate.end(), allowed);
+}
+
+class Client {
+public:
+    // Throws std::runtime_error when there is no compatible segment.
+    explicit Client(std::string name) : name(std::move(name)) {
+        attach();
+    }
+
+    Client(Client const&) = delete;
+    Client& operator=(Client const&) = delete;
+
+    ~Client() {
+        detach();
+    }
+
+    // Returns the end of the active ticket of plate, in seconds after
+    // midnight, or nothing when it has no active ticket.
+    std::optional<uint32_t> ticketEnd(std::string_view plate) {
+        if (!validRegistration(plate))
+            return std::nullopt;
+
+        if (header->retired.load(std::memory_order_acquire)) {
+            detach();
+            attach(true);
+        }
+
+        uint32_t end = 0, clock = 0;
+
+        if (!table->lookup(registrationFromString(plate), end, clock))
+            return std::nullopt;
+
+        return end;
+    }
+
+    bool ticketActive(std::string_view plate) {
+        return ticketEnd(plate).has_value();
+    }
+
+private:
+    std::string name;
+    Header* header = nullptr;
+    size_t size = 0;
+    std::optional<seqlock_table::Table> table;
+
+    // Maps the segment, waiting while it is being published. A missing
+    // name is only waited for when replacing a retired segment.
+    void attach(bool replacing = false) {
+        auto deadline = std::chrono::steady_clock::now() + PUBLISHING_TIMEOUT;
+
+        while (!tryAttach(replacing)) {
+            if (std::chrono::steady_clock::now() > deadline)
+                throw std::runtime_error("incomplete shared memory " + name);
+
+            std::this_thread::sleep_for(PUBLISHING_POLL);
+        }
+    }
+
+    // Returns false if the segment is not published yet.
+    bool tryAttach(bool replacing) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+        if (fd < 0 && errno == ENOENT && replacing)
+            return false;
+
+        if (fd < 0)
+            throw std::runtime_error("cannot open shared memory " + name);
+
+        struct stat status;
+
+        if (fstat(fd, &status)) {
+            close(fd);
+            throw std::runtime_error("cannot open shared memory " + name);
+        }
+
+        if (status.st_size < ssize_t(sizeof(Header))) {
+            close(fd);
+            return false;
+        }
+
+        size = status.st_size;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("cannot map shared memory " + name);
+
+        header = static_cast<Header*>(mapping);
+        uint32_t version = header->version.load(std::memory_order_acquire);
+
+        if (version == 0) {
+            detach();
+            return false;
+        }
+
+        if (version != LAYOUT_VERSION || header->magic != MAGIC ||
+            size < segmentSize(header->bucketCount)) {
+            detach();
+            throw std::runtime_error("incompatible shared memory " + name);
+        }
+
+        table.emplace(header + 1);
+        return true;
+    }
+
+    void detach() noexcept {
+        table.reset();
+
+        if (header)
+            munmap(header, size);
+
+        header = nullptr;
+    }
+};
+
+}  // namespace parking_shm
+
+#endif  // PARKING_SHM_H
@@ -0,0 +1,187 @@
+#ifndef REFERENCE_VERIFIER_H
+#define REFERENCE_VERIFIER_H
+
+// The verifier as it was first written, with the default rules built into
+// its regular expression, kept as the oracle that optimized versions are
+// checked against. Only the encoding of '9' in registrations is fixed.
+//
+// Do not optimize this code: it is meant to stay obviously right.
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <regex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace reference_verifier {
+
+// hours and minutes
+using Time = std::pair<uint16_t, uint16_t>;
+using TimeInterval = std::pair<Time, Time>;
+using Registration = uint64_t;
+
+constexpr uint16_t timeToMinutes(Time time) {
+    return 60 * time.first + time.second;
+}
+
+constexpr uint16_t MINIMAL_PARKING_MINUTES = timeToMinutes(Time{0, 10});
+constexpr uint16_t MAXIMAL_PARKING_MINUTES = timeToMinutes(Time{11, 59});
+constexpr Time OPENING_TIME = Time{8, 0};
+constexpr Time CLOSING_TIME = Time{20, 0};
+constexpr Time AFTER_CLOSING_TIME = Time{20, 1};
+
+constexpr std::string_view VALID_TIME =
+    R"-(((?:0?[89]|1[0-9])\.[0-5][0-9]|20\.00))-";
+constexpr std::string_view registration = R"-(([A-Z][A-Z0-9]{2,10}))-";
+
+inline const std::string INPUT_LINE =
+    "^\\s*" + std::string(registration) + "\\s+" + std::string(VALID_TIME) +
+    "(?:\\s+" + std::string(VALID_TIME) + ")?\\s*$";
+
+class Verifier {
+public:
+    // Answers every line of in on out, or with an ERROR on errors.
+    void run(std::istream& in, std::ostream& out, std::ostream& errors) {
+        std::string line;
+        size_t lineId = 0;
+        Time prevTime{8, 0};
+        std::smatch match;
+
+        while (std::getline(in, line)) {
+            lineId++;
+
+            if (!std::regex_match(line, match, lineRegex)) {
+                errors << "ERROR " << lineId << "\n";
+                continue;
+            }
+
+            Registration registration = registrationFromString(
+                std::string_view(match[1].first, match[1].second));
+            Time endTime, newTime = readTime(
+                std::string_view(match[2].first, match[2].second));
+
+            // ticket registration detection
+            if (match[3].matched) {
+                endTime = readTime(std::string_view(match[3].first,
+                                                    match[3].second));
+
+                if (!checkTicketLength(newTime, endTime)) {
+                    errors << "ERROR " << lineId << "\n";
+                    continue;
+                }
+            }
+
+            if (prevTime != newTime)
+                updateRegister(prevTime, newTime);
+
+            prevTime = newTime;
+
+            if (match[3].matched) {
+                registerTicket(registration, newTime, endTime);
+                out << "OK " << lineId << "\n";
+            } else if (registeredCars.contains(registration)) {
+                out << "YES " << lineId << "\n";
+            } else {
+                out << "NO " << lineId << "\n";
+            }
+        }
+    }
+
+private:
+    std::unordered_map<Registration, Time> registeredCars{};
+    std::set<std::pair<Time, Registration>> tickets{};
+    std::regex lineRegex{INPUT_LINE, std::regex_constants::optimize |
+                                         std::regex_constants::ECMAScript};
+
+    static Time readTime(std::string_view input) {
+        Time result;
+        std::from_chars(input.begin(), input.end(), result.first);
+        std::from_chars(input.end() - 2, input.end(), result.second);
+        return result;
+    }
+
+    static bool earlierOrEqual(Time lhs, Time rhs) {
+        return timeToMinutes(lhs) <= timeToMinutes(rhs);
+    }
+
+    static uint16_t duration(Time begin, Time end) {
+        if (earlierOrEqual(begin, end))
+            return timeToMinutes(end) - timeToMinutes(begin);
+
+        return timeToMinutes(end) - timeToMinutes(OPENING_TIME)
+               - timeToMinutes(begin) + timeToMinutes(CLOSING_TIME);
+    }
+
+    static bool checkTicketLength(Time begin, Time end) {
+        uint16_t paidTime = duration(begin, end);
+
+        return MINIMAL_PARKING_MINUTES <= paidTime &&
+               paidTime <= MAXIMAL_PARKING_MINUTES;
+    }
+
+    // base 37: space 0, digits 1-10, letters 11-36
+    static Registration registrationFromString(std::string_view s) {
+        Registration out = 0;
+
+        for (size_t i = 0; i < 11; i++) {
+            if (s.length() > i && s[i] <= '9') {
+                out += s[i] - '0' + 1;
+            } else if (s.length() > i) {
+                out += s[i] - 'A' + 11;
+            }
+
+            out *= 37;
+        }
+
+        return out;
+    }
+
+    void registerTicket(Registration carRegistration, Time begin, Time end) {
+        auto ticket = registeredCars.find(carRegistration);
+
+        if (ticket != registeredCars.end()) {
+            Time oldTicketEnd = ticket->second;
+
+            // true if new ticket doesn't improve the old one
+            if ((oldTicketEnd > end &&
+                 (oldTicketEnd < begin || earlierOrEqual(begin, end))) ||
+                (oldTicketEnd < begin && earlierOrEqual(begin, end))) {
+                return;
+            }
+
+            tickets.erase({oldTicketEnd, carRegistration});
+        }
+
+        tickets.insert({end, carRegistration});
+        registeredCars[carRegistration] = end;
+    }
+
+    void removeTicketsCont(TimeInterval inter) {
+        auto begin = tickets.lower_bound({inter.first, 0});
+        auto end = tickets.upper_bound({inter.second, 0});
+
+        std::for_each(begin, end, [&](std::pair<Time, Registration> r) {
+            registeredCars.erase(r.second);
+        });
+        tickets.erase(begin, end);
+    }
+
+    void updateRegister(Time oldTime, Time newTime) {
+        if (newTime < oldTime) {
+            removeTicketsCont({oldTime, AFTER_CLOSING_TIME});
+            removeTicketsCont({OPENING_TIME, newTime});
+        } else {
+            removeTicketsCont({oldTime, newTime});
+        }
+    }
+};
+
+}  // namespace reference_verifier
+
+#endif  // REFERENCE_VERIFIER_H
@@ -0,0 +1,87 @@
+#ifndef REGISTRATION_H
+#define REGISTRATION_H
+
+// Registrations are kept as numbers, both in the verifier and in the
+// processes reading its shared memory export.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#ifdef PARKING_WIDE_PLATES
+// foreign and diplomatic plates of up to 16 characters need 128 bits
+using Registration = unsigned __int128;
+
+constexpr size_t MAXIMAL_REGISTRATION_LENGTH = 16;
+#else
+// we can keep registration encoded in 64 bits
+using Registration = uint64_t;
+
+constexpr size_t MAXIMAL_REGISTRATION_LENGTH = 11;
+#endif
+
+// Hash of registrations for the hash tables of the verifier.
+struct RegistrationHash {
+    size_t operator()(Registration registration) const noexcept {
+#ifdef PARKING_WIDE_PLATES
+        // folds the halves together and mixes them with the finalizer of
+        // MurmurHash3, std::hash has no specialization for 128 bits
+        uint64_t key = uint64_t(registration) ^
+                       uint64_t(registration >> 64) * 0x9e3779b97f4a7c15ULL;
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+#else
+        return std::hash<Registration>{}(registration);
+#endif
+    }
+};
+
+// Encodes registration as a number, 64 or 128 bits wide,
+// by treating it as a numbering system with base 37.
+// Encoding assigns
+// - empty space to 0
+// - digits 0-9 to digits 1-10
+// - letters A-Z to digits 11-36
+inline Registration registrationFromString(std::string_view s) {
+    Registration out = 0;
+
+    for (size_t i = 0; i < MAXIMAL_REGISTRATION_LENGTH; i++) {
+        if (s.length() > i && s[i] <= '9') {
+            out += s[i] - '0' + 1;
+        } else if (s.length() > i) {
+            out += s[i] - 'A' + 11;
+        }
+
+        out *= 37;
+    }
+
+    return out;
+}
+
+// Inverse of registrationFromString.
+inline std::string registrationToString(Registration registration) {
+    std::string out(MAXIMAL_REGISTRATION_LENGTH, ' ');
+    registration /= 37;
+
+    for (size_t i = MAXIMAL_REGISTRATION_LENGTH; i-- > 0;) {
+        uint16_t digit = registration % 37;
+        registration /= 37;
+
+        if (digit == 0)
+            out.pop_back();
+        else if (digit <= 10)
+            out[i] = '0' + digit - 1;
+        else
+            out[i] = 'A' + digit - 11;
+    }
+
+    return out;
+}
+
+#endif  // REGISTRATION_H
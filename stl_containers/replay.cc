@@ -0,0 +1,262 @@
+// Replays a workload captured with `parking --capture FILE` against the
+// parking verifier, preserving the original burst shape, and reports
+// per-line response latency and throughput.
+//
+// usage: replay FILE [--speed N|max] [-- COMMAND [ARGS...]]
+//
+// The verifier answers every input line with exactly one line on stdout or
+// stderr that carries the line number, which is how responses are matched
+// with the moment their line was sent.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "replay_format.h"
+
+using Clock = std::chrono::steady_clock;
+using Nanoseconds = std::chrono::nanoseconds;
+
+// delay before each line, already divided by the speed-up factor
+using Workload = std::vector<std::pair<Nanoseconds, std::string>>;
+
+constexpr std::string_view USAGE = " FILE [--speed N|max] [-- COMMAND ...]";
+
+bool loadWorkload(char const* path, double speed, Workload& workload) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic(REPLAY_MAGIC.length(), '\0');
+
+    if (!in.read(magic.data(), magic.length()) || magic != REPLAY_MAGIC)
+        return false;
+
+    uint64_t delayNs;
+    std::string line;
+
+    while (readReplayRecord(in, delayNs, line)) {
+        // speed 0 means as fast as possible
+        auto delay = speed == 0 ? Nanoseconds(0)
+                                : Nanoseconds(static_cast<int64_t>(
+                                      delayNs / speed));
+        workload.emplace_back(delay, line);
+    }
+
+    return true;
+}
+
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = write(fd, data.data(), data.size());
+
+        if (written < 0)
+            return false;
+
+        data.remove_prefix(written);
+    }
+
+    return true;
+}
+
+// Sends the workload to fd keeping the recorded gaps between lines.
+void feed(int fd, Workload const& workload,
+          std::vector<std::atomic<int64_t>>& sendTimes) {
+    auto next = Clock::now();
+    std::string buffer;
+
+    for (size_t i = 0; i < workload.size(); i++) {
+        next += workload[i].first;
+        std::this_thread::sleep_until(next);
+
+        buffer.assign(workload[i].second);
+        buffer.push_back('\n');
+        sendTimes[i].store(Clock::now().time_since_epoch().count(),
+                           std::memory_order_release);
+
+        if (!writeAll(fd, buffer))
+            break;
+    }
+
+    close(fd);
+}
+
+// Verdicts that start a response; the verifier writes other lines too,
+// e.g. the statistics of --stats.
+constexpr std::array<std::string_view, 5> VERDICTS{"OK", "YES", "NO", "MAYBE",
+                                                   "ERROR"};
+
+// Line number of a response such as "OK 17" or "MAYBE 3 WB12345", or 0 for
+// a line that is not a response.
+size_t responseLineId(std::string_view response) {
+    size_t lineId = 0;
+    size_t space = response.find(' ');
+
+    if (space == std::string_view::npos ||
+        std::find(VERDICTS.begin(), VERDICTS.end(),
+                  response.substr(0, space)) == VERDICTS.end())
+        return 0;
+
+    std::from_chars(response.data() + space + 1,
+                    response.data() + response.size(), lineId);
+    return lineId;
+}
+
+Nanoseconds percentile(std::vector<Nanoseconds>& latencies, double fraction) {
+    size_t rank = std::min(latencies.size() - 1,
+                           static_cast<size_t>(fraction * latencies.size()));
+
+    std::nth_element(latencies.begin(), latencies.begin() + rank,
+                     latencies.end());
+    return latencies[rank];
+}
+
+void report(std::vector<Nanoseconds>& latencies, Nanoseconds elapsed) {
+    using std::chrono::duration_cast;
+    using Microseconds = std::chrono::duration<double, std::micro>;
+
+    std::cout << "lines " << latencies.size() << "\n";
+
+    if (latencies.empty())
+        return;
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    std::cout << "throughput " << latencies.size() / seconds
+              << " lines/s\n";
+
+    for (auto [name, fraction] : {std::pair{"p50", 0.5}, {"p99", 0.99},
+                                  {"p999", 0.999}, {"max", 1.0}}) {
+        std::cout << name << " "
+                  << duration_cast<Microseconds>(
+                         percentile(latencies, fraction)).count()
+                  << " us\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << USAGE << "\n";
+        return 1;
+    }
+
+    double speed = 1;
+    std::vector<char*> command{const_cast<char*>("./parking"),
+                               const_cast<char*>("--line-buffered")};
+
+    for (int i = 2; i < argc; i++) {
+        std::string_view option(argv[i]);
+
+        if (option == "--speed" && i + 1 < argc) {
+            option = argv[++i];
+            speed = option == "max" ? 0 : std::stod(argv[i]);
+        } else if (option == "--" && i + 1 < argc) {
+            command.assign(argv + i + 1, argv + argc);
+            break;
+        } else {
+            std::cerr << "usage: " << argv[0] << USAGE << "\n";
+            return 1;
+        }
+    }
+
+    command.push_back(nullptr);
+
+    Workload workload;
+
+    if (!loadWorkload(argv[1], speed, workload)) {
+        std::cerr << "cannot read replay file " << argv[1] << "\n";
+        return 1;
+    }
+
+    int input[2], output[2], errors[2];
+
+    if (pipe(input) || pipe(output) || pipe(errors)) {
+        std::cerr << "cannot create pipes\n";
+        return 1;
+    }
+
+    pid_t child = fork();
+
+    if (child == 0) {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        dup2(errors[1], STDERR_FILENO);
+
+        for (int fd : {input[0], input[1], output[0], output[1], errors[0],
+                       errors[1]})
+            close(fd);
+
+        execvp(command[0], command.data());
+        _exit(127);
+    }
+
+    close(input[0]);
+    close(output[1]);
+    close(errors[1]);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::atomic<int64_t>> sendTimes(workload.size());
+    auto start = Clock::now();
+    std::thread feeder(feed, input[1], std::cref(workload),
+                       std::ref(sendTimes));
+
+    std::vector<Nanoseconds> latencies;
+    latencies.reserve(workload.size());
+
+    pollfd fds[] = {{output[0], POLLIN, 0}, {errors[0], POLLIN, 0}};
+    std::string pending[2];
+    char buffer[1 << 16];
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+        if (poll(fds, 2, -1) < 0)
+            break;
+
+        for (size_t i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+
+            ssize_t length = read(fds[i].fd, buffer, sizeof(buffer));
+
+            if (length <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                continue;
+            }
+
+            auto now = Clock::now().time_since_epoch().count();
+            pending[i].append(buffer, length);
+            size_t begin = 0, end;
+
+            while ((end = pending[i].find('\n', begin)) != std::string::npos) {
+                size_t lineId = responseLineId(
+                    std::string_view(pending[i]).substr(begin, end - begin));
+
+                if (lineId > 0 && lineId <= sendTimes.size()) {
+                    latencies.emplace_back(
+                        now - sendTimes[lineId - 1].load(
+                                  std::memory_order_acquire));
+                }
+
+                begin = end + 1;
+            }
+
+            pending[i].erase(0, begin);
+        }
+    }
+
+    auto elapsed = Clock::now() - start;
+    feeder.join();
+    waitpid(child, nullptr, 0);
+    report(latencies, elapsed);
+}
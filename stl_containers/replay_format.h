@@ -0,0 +1,62 @@
+#ifndef REPLAY_FORMAT_H
+#define REPLAY_FORMAT_H
+
+// Replay files hold captured input lines together with the time that
+// passed between their arrivals. After REPLAY_MAGIC every record is
+// <delay in nanoseconds> <line length> <line bytes>, where both numbers are
+// LEB128 varints, so a typical line costs only a few bytes of overhead.
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+constexpr std::string_view REPLAY_MAGIC = "PKREPLAY1\n";
+
+inline void writeVarint(std::ostream& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.put(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+
+    out.put(static_cast<char>(value));
+}
+
+inline bool readVarint(std::istream& in, uint64_t& value) {
+    value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+
+        if (byte == std::istream::traits_type::eof())
+            return false;
+
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+inline void writeReplayRecord(std::ostream& out, uint64_t delayNs,
+                              std::string_view line) {
+    writeVarint(out, delayNs);
+    writeVarint(out, line.length());
+    out.write(line.data(), line.length());
+}
+
+inline bool readReplayRecord(std::istream& in, uint64_t& delayNs,
+                             std::string& line) {
+    uint64_t length;
+
+    if (!readVarint(in, delayNs) || !readVarint(in, length))
+        return false;
+
+    line.resize(length);
+    return static_cast<bool>(in.read(line.data(), length));
+}
+
+#endif  // REPLAY_FORMAT_H
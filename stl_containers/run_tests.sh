@@ -9,8 +9,42 @@ for infile in tests/test_*.in; do
     # Extract the base name of the file
     base=${infile%.in}
 
-    # Run the program with the input file and capture output and error
-    $PROGRAM < "$infile" > "${base}.actual.out" 2> "${base}.actual.err"
+    # Extra command line options for the test, if any
+    args=()
+    if [[ -f "${base}.args" ]]; then
+        read -ra args < "${base}.args"
+    fi
+
+    # A test with a .pre input runs the program on it first, with the same
+    # options, and checks only the second run, which recovers from the
+    # journal ${base}.journal left by the first one
+    if [[ -f "${base}.pre" ]]; then
+        rm -f "${base}.journal"
+        $PROGRAM "${args[@]}" < "${base}.pre" > /dev/null 2>&1
+    fi
+
+    # Run the program with the input file and capture output and error.
+    # A test with a .expired file passes --expired ${base}.actual.expired
+    # in its options; the notifications have to be written while the input
+    # is still open, so they are taken before it is closed.
+    if [[ -f "${base}.expired" ]]; then
+        rm -f "${base}.actual.expired"
+        { cat "$infile"; sleep 0.5; cp "${base}.actual.expired" "${base}.idle.expired"; } |
+            $PROGRAM "${args[@]}" > "${base}.actual.out" 2> "${base}.actual.err"
+        if ! diff -q "${base}.expired" "${base}.idle.expired" >/dev/null; then
+            echo "Expired diff:" >> "${base}.actual.err"
+            diff "${base}.expired" "${base}.idle.expired" >> "${base}.actual.err"
+        fi
+        rm -f "${base}.actual.expired" "${base}.idle.expired"
+    else
+        $PROGRAM "${args[@]}" < "$infile" > "${base}.actual.out" 2> "${base}.actual.err"
+    fi
+
+    # the time that recovery took differs from run to run
+    if [[ -f "${base}.pre" ]]; then
+        sed -i 's/^\(journal recovered .*\) in .* ms$/\1/' "${base}.actual.err"
+        rm -f "${base}.journal"
+    fi
 
     # Check if output and error match expected results
     if diff -q "${base}.out" "${base}.actual.out" >/dev/null && diff -q "${base}.err" "${base}.actual.err" >/dev/null; then
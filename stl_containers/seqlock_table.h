@@ -0,0 +1,331 @@
+#ifndef SEQLOCK_TABLE_H
+#define SEQLOCK_TABLE_H
+
+// Open addressing hash table from registrations to ticket ends, written by
+// one thread and read by any number of lock-free readers.
+//
+// The table lives in a caller-provided memory region, so it can be placed
+// on the heap as well as in memory shared with other processes. The region
+// holds a header and two arrays of cache-line sized buckets; only one of
+// them is live, the other one is where the writer rebuilds the table to get
+// rid of deleted entries.
+//
+// Every bucket is guarded by its own sequence lock, so a purchase only
+// disturbs readers of one bucket. Moving the clock, which removes many
+// tickets at once, and switching the live array are guarded by the sequence
+// lock in the header, so that a reader always sees the table as it was at
+// a single clock value.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace seqlock_table {
+
+constexpr uint64_t EMPTY_KEY = 0;
+constexpr uint64_t DELETED_KEY = ~uint64_t{0};
+constexpr size_t BUCKET_SLOTS = 4;
+
+struct alignas(64) Bucket {
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> values[BUCKET_SLOTS];
+    std::atomic<uint64_t> keys[BUCKET_SLOTS];
+};
+
+struct alignas(64) Header {
+    // odd while the writer moves the clock or switches the live array
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> clock;
+    std::atomic<uint32_t> liveArray;
+    uint32_t bucketCount;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "readers in other processes rely on address-free atomics");
+
+inline uint64_t mix(uint64_t key) {
+    // finalizer of MurmurHash3
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+class Table {
+public:
+    // Size of the region for a table of bucketCount (a power of two)
+    // buckets.
+    static constexpr size_t regionSize(size_t bucketCount) {
+        return sizeof(Header) + 2 * bucketCount * sizeof(Bucket);
+    }
+
+    // Formats an empty table in the region; used by the writer.
+    Table(void* region, uint32_t bucketCount)
+        : header(new (region) Header{}),
+          buckets(new (header + 1) Bucket[2 * bucketCount]{}) {
+        header->bucketCount = bucketCount;
+    }
+
+    // Attaches to a table formatted by the writer; used by readers.
+    explicit Table(void* region)
+        : header(static_cast<Header*>(region)),
+          buckets(reinterpret_cast<Bucket*>(header + 1)) {}
+
+    uint32_t bucketCount() const noexcept {
+        return header->bucketCount;
+    }
+
+    size_t capacity() const noexcept {
+        return header->bucketCount * BUCKET_SLOTS;
+    }
+
+    // Number of live entries, maintained by the writer only.
+    size_t size() const noexcept {
+        return live;
+    }
+
+    // Looks key up in a consistent snapshot. Returns whether it is present
+    // and sets value to its entry and clock to the clock of the snapshot.
+    bool lookup(uint64_t key, uint32_t& value, uint32_t& clock) const {
+        for (;;) {
+            uint32_t sequence = header->sequence.load(std::memory_order_acquire);
+
+            if (sequence & 1)
+                continue;
+
+            clock = header->clock.load(std::memory_order_relaxed);
+            Bucket const* array =
+                liveBuckets(header->liveArray.load(std::memory_order_relaxed));
+            bool found = probe(array, key, value);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (header->sequence.load(std::memory_order_relaxed) == sequence)
+                return found;
+        }
+    }
+
+    // Clock changes and array switches happen between beginUpdate and
+    // endUpdate, which may nest; readers retry lookups that overlap them.
+    void beginUpdate() noexcept {
+        if (updateDepth++ == 0)
+            lock(header->sequence);
+    }
+
+    void endUpdate() noexcept {
+        if (--updateDepth == 0)
+            unlock(header->sequence);
+    }
+
+    void setClock(uint32_t clock) noexcept {
+        header->clock.store(clock, std::memory_order_relaxed);
+    }
+
+    // Inserts key or overwrites its value. Returns false when the table is
+    // too full to take it; the caller should then move to a bigger table.
+    bool insert(uint64_t key, uint32_t value) {
+        Bucket* bucket = nullptr;
+        size_t slot = 0;
+
+        if (findSlot(key, bucket, slot)) {
+            write(*bucket, slot, key, value);
+            return true;
+        }
+
+        if (2 * (live + 1) > capacity())
+            return false;
+
+        if (4 * (used + 1) > 3 * capacity())
+            rebuild();
+
+        bucket = nullptr;
+
+        for (size_t i = home(key);; i = (i + 1) & mask()) {
+            Bucket& candidate = writerBuckets()[i];
+
+            for (size_t s = 0; s < BUCKET_SLOTS; s++) {
+                uint64_t stored = candidate.keys[s].load(std::memory_order_relaxed);
+
+                if (stored == EMPTY_KEY || stored == DELETED_KEY) {
+                    bucket = &candidate;
+                    slot = s;
+                    used += stored == EMPTY_KEY;
+                    break;
+                }
+            }
+
+            if (bucket)
+                break;
+        }
+
+        write(*bucket, slot, key, value);
+        live++;
+        return true;
+    }
+
+    void erase(uint64_t key) {
+        Bucket* bucket = nullptr;
+        size_t slot = 0;
+
+        if (findSlot(key, bucket, slot)) {
+            write(*bucket, slot, DELETED_KEY, 0);
+            live--;
+        }
+    }
+
+private:
+    Header* header;
+    Bucket* buckets;
+    // writer-side bookkeeping; used counts live and deleted slots
+    size_t live = 0;
+    size_t used = 0;
+    size_t updateDepth = 0;
+
+    size_t mask() const noexcept {
+        return header->bucketCount - 1;
+    }
+
+    size_t home(uint64_t key) const noexcept {
+        return mix(key) & mask();
+    }
+
+    Bucket* liveBuckets(uint32_t array) const noexcept {
+        return buckets + (array & 1) * header->bucketCount;
+    }
+
+    Bucket* writerBuckets() const noexcept {
+        return liveBuckets(header->liveArray.load(std::memory_order_relaxed));
+    }
+
+    static void lock(std::atomic<uint32_t>& sequence) noexcept {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void unlock(std::atomic<uint32_t>& sequence) noexcept {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+    }
+
+    static void write(Bucket& bucket, size_t slot, uint64_t key,
+                      uint32_t value) noexcept {
+        lock(bucket.sequence);
+        bucket.keys[slot].store(key, std::memory_order_relaxed);
+        bucket.values[slot].store(value, std::memory_order_relaxed);
+        unlock(bucket.sequence);
+    }
+
+    // Reader side probing; every bucket is read under its sequence lock.
+    bool probe(Bucket const* array, uint64_t key, uint32_t& value) const {
+        size_t i = home(key);
+
+        for (size_t visited = 0; visited <= mask(); visited++) {
+            Bucket const& bucket = array[i];
+            uint32_t sequence;
+            bool found = false, empty = false;
+
+            do {
+                sequence = bucket.sequence.load(std::memory_order_acquire);
+
+                if (sequence & 1)
+                    continue;
+
+                found = empty = false;
+
+                for (size_t s = 0; s < BUCKET_SLOTS && !found && !empty; s++) {
+                    uint64_t stored = bucket.keys[s].load(std::memory_order_relaxed);
+
+                    found = stored == key;
+                    empty = stored == EMPTY_KEY;
+
+                    if (found)
+                        value = bucket.values[s].load(std::memory_order_relaxed);
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+            } while ((sequence & 1) ||
+                     bucket.sequence.load(std::memory_order_relaxed) != sequence);
+
+            if (found || empty)
+                return found;
+
+            i = (i + 1) & mask();
+        }
+
+        return false;
+    }
+
+    // Writer side lookup of the slot holding key.
+    bool findSlot(uint64_t key, Bucket*& bucket, size_t& slot) const {
+        for (size_t i = home(key), visited = 0; visited <= mask();
+             i = (i + 1) & mask(), visited++) {
+            bucket = &writerBuckets()[i];
+
+            for (slot = 0; slot < BUCKET_SLOTS; slot++) {
+                uint64_t stored = bucket->keys[slot].load(std::memory_order_relaxed);
+
+                if (stored == key)
+                    return true;
+
+                if (stored == EMPTY_KEY)
+                    return false;
+            }
+        }
+
+        return false;
+    }
+
+    // Copies live entries to the other array and makes it the live one.
+    void rebuild() {
+        uint32_t array = header->liveArray.load(std::memory_order_relaxed);
+        Bucket* from = liveBuckets(array);
+        Bucket* to = liveBuckets(array + 1);
+
+        for (size_t i = 0; i <= mask(); i++) {
+            for (size_t s = 0; s < BUCKET_SLOTS; s++)
+                write(to[i], s, EMPTY_KEY, 0);
+        }
+
+        used = 0;
+
+        for (size_t i = 0; i <= mask(); i++) {
+            for (size_t s = 0; s < BUCKET_SLOTS; s++) {
+                uint64_t key = from[i].keys[s].load(std::memory_order_relaxed);
+
+                if (key == EMPTY_KEY || key == DELETED_KEY)
+                    continue;
+
+                uint32_t value = from[i].values[s].load(std::memory_order_relaxed);
+                size_t j = home(key);
+
+                for (;; j = (j + 1) & mask()) {
+                    size_t free = 0;
+
+                    while (free < BUCKET_SLOTS &&
+                           to[j].keys[free].load(std::memory_order_relaxed)
+                               != EMPTY_KEY)
+                        free++;
+
+                    if (free < BUCKET_SLOTS) {
+                        write(to[j], free, key, value);
+                        break;
+                    }
+                }
+
+                used++;
+            }
+        }
+
+        beginUpdate();
+        header->liveArray.store(array + 1, std::memory_order_relaxed);
+        endUpdate();
+    }
+};
+
+}  // namespace seqlock_table
+
+#endif  // SEQLOCK_TABLE_H
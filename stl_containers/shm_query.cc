@@ -0,0 +1,42 @@
+// Checks tickets in the table exported by `parking --shm NAME`.
+//
+// usage: shm_query NAME PLATE...
+//
+// For every plate prints YES with the end of its ticket, or NO.
+
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "parking_shm.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " NAME PLATE...\n";
+        return 1;
+    }
+
+    try {
+        parking_shm::Client client(argv[1]);
+
+        for (int i = 2; i < argc; i++) {
+            auto end = client.ticketEnd(argv[i]);
+
+            if (end) {
+                std::cout << argv[i] << " YES " << *end / 3600 << "."
+                          << std::setw(2) << std::setfill('0')
+                          << *end / 60 % 60;
+
+                if (*end % 60 != 0)
+                    std::cout << "." << std::setw(2) << *end % 60;
+
+                std::cout << "\n";
+            } else {
+                std::cout << argv[i] << " NO\n";
+            }
+        }
+    } catch (std::runtime_error const& error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,172 @@
+// Replays recorded input under many candidate tariff rules at once.
+//
+// usage: simulate INPUT RULES [THREADS]
+//
+// RULES has one candidate per line:
+//     <name> <opening time> <closing time> <minimal time> <maximal time>
+// for example "late 8.00 22.00 0.10 13.59". INPUT is parsed once and every
+// candidate runs its own engine over the parsed events on a pool of
+// threads. For every candidate the totals of OK, YES, NO and ERROR answers
+// are reported, together with the paid minutes of accepted tickets.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "parking_engine.h"
+#include "parking_input.h"
+
+struct Candidate {
+    std::string name;
+    RuntimeRules rules;
+};
+
+struct Totals {
+    size_t ok = 0;
+    size_t yes = 0;
+    size_t no = 0;
+    size_t error = 0;
+    uint64_t paidSeconds = 0;
+};
+
+// Reads the candidates from path; reports what is wrong with a line that
+// does not describe valid rules.
+bool readCandidates(char const* path, std::vector<Candidate>& candidates) {
+    std::ifstream in(path);
+    std::regex validTime{std::string(VALID_TIME)};
+    std::string line;
+    size_t lineNumber = 0;
+
+    auto invalid = [&](std::string_view reason) {
+        std::cerr << path << ":" << lineNumber << ": " << reason << "\n";
+        return false;
+    };
+
+    if (!in) {
+        std::cerr << "cannot open " << path << "\n";
+        return false;
+    }
+
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name, opening, closing, minimal, maximal;
+
+        lineNumber++;
+
+        if (!(fields >> name))
+            continue;
+
+        if (!(fields >> opening >> closing >> minimal >> maximal))
+            return invalid("expected <name> <opening time> <closing time> "
+                           "<minimal time> <maximal time>");
+
+        for (std::string const* time : {&opening, &closing, &minimal, &maximal}) {
+            if (!std::regex_match(*time, validTime))
+                return invalid("invalid time " + *time);
+        }
+
+        RuntimeRules rules{readTime(opening), readTime(closing),
+                           timeToMinutes(readTime(minimal)),
+                           timeToMinutes(readTime(maximal))};
+
+        if (rules.openingTime >= rules.closingTime)
+            return invalid("opening time is not before closing time");
+
+        if (rules.minimalParkingMinutes > rules.maximalParkingMinutes)
+            return invalid("minimal time is longer than maximal time");
+
+        // tickets have to be shorter than a day, see ParkingRules
+        if (rules.maximalParkingMinutes >= timeToMinutes(rules.closingTime) -
+                                           timeToMinutes(rules.openingTime))
+            return invalid("maximal time is not shorter than opening hours");
+
+        candidates.push_back({name, rules});
+    }
+
+    return in.eof() || invalid("cannot read");
+}
+
+Totals simulate(RuntimeRules rules, std::vector<Event> const& events) {
+    Engine<RuntimeRules> engine(rules);
+    Totals totals;
+
+    for (Event const& event : events) {
+        if (!engine.admit(event)) {
+            totals.error++;
+        } else if (event.kind == Event::Kind::Purchase) {
+            engine.registerTicket(event.registration, event.begin, event.end);
+            totals.ok++;
+            totals.paidSeconds += engine.duration(event.begin, event.end);
+        } else if (engine.ticketActive(event.registration)) {
+            totals.yes++;
+        } else {
+            totals.no++;
+        }
+    }
+
+    return totals;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " INPUT RULES [THREADS]\n";
+        return 1;
+    }
+
+    std::vector<Candidate> candidates;
+
+    if (!readCandidates(argv[2], candidates))
+        return 1;
+
+    if (candidates.empty()) {
+        std::cerr << "no rules in " << argv[2] << "\n";
+        return 1;
+    }
+
+    std::ifstream input(argv[1]);
+    std::vector<Event> events;
+    std::string line;
+    LineParser parser;
+
+    if (!input) {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 1;
+    }
+
+    while (std::getline(input, line))
+        events.push_back(parser.parse(line));
+
+    size_t threadCount = argc > 3 ? std::stoul(argv[3])
+                                  : std::thread::hardware_concurrency();
+    threadCount = std::clamp<size_t>(threadCount, 1, candidates.size());
+
+    std::vector<Totals> totals(candidates.size());
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> pool;
+
+    for (size_t t = 0; t < threadCount; t++) {
+        pool.emplace_back([&] {
+            for (size_t i; (i = next.fetch_add(1)) < candidates.size();)
+                totals[i] = simulate(candidates[i].rules, events);
+        });
+    }
+
+    for (auto& thread : pool)
+        thread.join();
+
+    std::cout << "rules OK YES NO ERROR paid-minutes\n";
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        std::cout << candidates[i].name << " " << totals[i].ok << " "
+                  << totals[i].yes << " " << totals[i].no << " "
+                  << totals[i].error << " " << totals[i].paidSeconds / 60 << "\n";
+    }
+}
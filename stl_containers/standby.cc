@@ -0,0 +1,261 @@
+// Hot standby for a verifier started with `parking --replicate SOCKET`.
+//
+// usage: standby SOCKET [--rules NAME] [--takeover FILE]
+//
+// The standby follows the events of the primary in its own engine and
+// answers queries read from stdin, "<registration> <time>" lines, with YES
+// or NO as of the last replicated event; it accepts no purchases. Every
+// (re)connection starts with a checkpoint of the primary's tickets, so a
+// standby that falls behind or loses the primary simply catches up.
+//
+// When the primary is lost and --takeover FILE is given, the replicated
+// state is written to FILE as a journal, so that `parking --journal FILE`
+// can take over immediately.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "journal_format.h"
+#include "parking_engine.h"
+#include "parking_input.h"
+
+constexpr std::string_view USAGE = " SOCKET [--rules NAME] [--takeover FILE]";
+constexpr std::chrono::milliseconds RECONNECT_DELAY{100};
+
+template <StaticParkingRules Rules>
+constexpr std::pair<std::string_view, RuntimeRules> namedRules() {
+    return {Rules::name,
+            {Rules::openingTime, Rules::closingTime,
+             Rules::minimalParkingMinutes, Rules::maximalParkingMinutes}};
+}
+
+constexpr std::array RULES{
+    namedRules<DefaultRules>(),
+    namedRules<ExtendedHoursRules>(),
+    namedRules<ShortStayRules>(),
+};
+
+RuntimeRules rules;
+Engine<RuntimeRules> engine;
+std::mutex engineMutex;
+char const* takeoverPath = nullptr;
+
+int connectTo(char const* path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd >= 0 &&
+        connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Applies records from fd until the primary goes away or sends something
+// that is not a record.
+void follow(int fd) {
+    using journal::JOURNAL_MAGIC;
+    using journal::RECORD_SIZE;
+
+    std::string received;
+    size_t position = 0;
+    bool started = false;
+    char buffer[1 << 16];
+
+    while (true) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+
+        if (length < 0 && errno == EINTR)
+            continue;
+
+        if (length <= 0)
+            return;
+
+        received.append(buffer, length);
+
+        if (!started) {
+            if (received.size() < JOURNAL_MAGIC.size())
+                continue;
+
+            if (std::string_view(received).substr(0, JOURNAL_MAGIC.size()) !=
+                JOURNAL_MAGIC)
+                return;
+
+            position = JOURNAL_MAGIC.size();
+            started = true;
+        }
+
+        std::lock_guard lock(engineMutex);
+        journal::Record record;
+
+        for (; position + RECORD_SIZE <= received.size();
+             position += RECORD_SIZE) {
+            if (!journal::decodeRecord(received.data() + position, record))
+                return;
+
+            engine.updateRegister(record.begin);
+
+            if (record.kind == journal::Record::Kind::Purchase)
+                engine.registerTicket(record.registration, record.begin,
+                                      record.end);
+        }
+
+        received.erase(0, position);
+        position = 0;
+    }
+}
+
+// Writes the replicated state as a journal that parking can recover from.
+void writeTakeover() {
+    using journal::Record;
+
+    std::string records(journal::JOURNAL_MAGIC);
+    std::lock_guard lock(engineMutex);
+    Time clock = engine.currentTime();
+
+    journal::appendRecord(records, {Record::Kind::Clock, 0, 0, clock, {}});
+
+    for (auto [car, end] : engine.registeredCars())
+        journal::appendRecord(records, {Record::Kind::Purchase, 0, car, clock, end});
+
+    std::string temporary = std::string(takeoverPath) + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+
+    if (fd < 0 || write(fd, records.data(), records.size()) !=
+                      ssize_t(records.size()) || fdatasync(fd)) {
+        std::cerr << "cannot write " << takeoverPath << "\n";
+    } else {
+        rename(temporary.c_str(), takeoverPath);
+        std::clog << "state written to " << takeoverPath << "\n";
+    }
+
+    if (fd >= 0)
+        close(fd);
+}
+
+void replicate(char const* path) {
+    bool followed = false;
+
+    while (true) {
+        int fd = connectTo(path);
+
+        if (fd < 0) {
+            std::this_thread::sleep_for(RECONNECT_DELAY);
+            continue;
+        }
+
+        {
+            // the checkpoint at the beginning replaces everything
+            std::lock_guard lock(engineMutex);
+            engine = Engine<RuntimeRules>(rules);
+        }
+
+        if (!followed)
+            std::clog << "following " << path << "\n";
+
+        follow(fd);
+        close(fd);
+        followed = true;
+        std::clog << "primary lost\n";
+
+        if (takeoverPath)
+            writeTakeover();
+    }
+}
+
+// Whether the ticket of car is active at time, as the primary would answer
+// once its clock got there: moving the clock forgets the tickets that end
+// from the current time on and before time, on the next day if time is
+// earlier. The clock of the replica is left to the primary.
+bool activeAt(Registration car, Time time) {
+    auto ticket = engine.registeredCars().find(car);
+
+    if (ticket == engine.registeredCars().end())
+        return false;
+
+    Time clock = engine.currentTime(), end = ticket->second;
+
+    if (time < clock)
+        return end < clock && time <= end;
+
+    return end < clock || time <= end;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << USAGE << "\n";
+        return 1;
+    }
+
+    std::string_view rulesName = DefaultRules::name;
+
+    for (int i = 2; i < argc; i++) {
+        std::string_view option(argv[i]);
+
+        if (option == "--rules" && i + 1 < argc) {
+            rulesName = argv[++i];
+        } else if (option == "--takeover" && i + 1 < argc) {
+            takeoverPath = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << USAGE << "\n";
+            return 1;
+        }
+    }
+
+    auto named = std::find_if(RULES.begin(), RULES.end(), [&](auto const& r) {
+        return r.first == rulesName;
+    });
+
+    if (named == RULES.end()) {
+        std::cerr << "unknown rules " << rulesName << "\n";
+        return 1;
+    }
+
+    rules = named->second;
+    engine = Engine<RuntimeRules>(rules);
+    std::thread(replicate, argv[1]).detach();
+
+    std::string line;
+    size_t lineId = 0;
+    LineParser parser;
+
+    while (std::getline(std::cin, line)) {
+        lineId++;
+        Event event = parser.parse(line);
+        std::lock_guard lock(engineMutex);
+
+        if (event.kind != Event::Kind::Query || !engine.valid(event)) {
+            std::cerr << "ERROR " << lineId << "\n";
+            continue;
+        }
+
+        std::cout << (activeAt(event.registration, event.begin) ? "YES "
+                                                                : "NO ")
+                  << lineId << std::endl;
+    }
+
+    // the replication thread never ends, so the engine must not be
+    // destroyed under it
+    std::cout.flush();
+    std::_Exit(0);
+}
@@ -0,0 +1,467 @@
+#ifndef URING_STREAMS_H
+#define URING_STREAMS_H
+
+// Stream buffers doing their I/O through Linux io_uring, so that reading the
+// input and writing the answers overlaps with processing the lines.
+//
+// InputBuffer keeps several reads in flight, those of a pipe linked so that
+// they run in order. OutputBuffer hands every filled buffer to the kernel
+// and continues with a fresh one, except on a flush; only one write per
+// stream is in flight, so the output keeps its order. Every buffer has its
+// own ring, so streams used by different threads do not share anything.
+//
+// The buffers are installed with rdbuf() into the standard streams, which
+// keeps all the formatting code unchanged.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <streambuf>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace uring_streams {
+
+constexpr size_t BUFFER_SIZE = 1 << 16;
+constexpr size_t READ_DEPTH = 4;
+constexpr size_t MAXIMAL_QUEUED_WRITES = 64;
+// io_uring uses and updates the current file position for this offset
+constexpr uint64_t CURRENT_POSITION = ~uint64_t{0};
+
+// A minimal io_uring instance driven with raw system calls.
+class Ring {
+public:
+    // Throws std::system_error when io_uring is not available.
+    explicit Ring(unsigned entries) {
+        io_uring_params params{};
+
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(),
+                                    "io_uring_setup");
+
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize = params.cq_off.cqes +
+                 params.cq_entries * sizeof(io_uring_cqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sqSize = cqSize = std::max(sqSize, cqSize);
+
+        sqRing = map(sqSize, IORING_OFF_SQ_RING);
+        cqRing = params.features & IORING_FEAT_SINGLE_MMAP
+                     ? sqRing
+                     : map(cqSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+
+        auto at = [](void* ring, unsigned offset) {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+        };
+
+        sqHead = at(sqRing, params.sq_off.head);
+        sqTail = at(sqRing, params.sq_off.tail);
+        sqMask = *at(sqRing, params.sq_off.ring_mask);
+        sqArray = at(sqRing, params.sq_off.array);
+        sqEntries = params.sq_entries;
+        cqHead = at(cqRing, params.cq_off.head);
+        cqTail = at(cqRing, params.cq_off.tail);
+        cqMask = *at(cqRing, params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(
+            static_cast<char*>(cqRing) + params.cq_off.cqes);
+    }
+
+    Ring(Ring const&) = delete;
+    Ring& operator=(Ring const&) = delete;
+
+    ~Ring() {
+        munmap(sqes, sqesSize);
+
+        if (cqRing != sqRing)
+            munmap(cqRing, cqSize);
+
+        munmap(sqRing, sqSize);
+        close(fd);
+    }
+
+    // flags of the request, e.g. IOSQE_IO_LINK to run the next one after it
+    void read(int file, char* buffer, size_t size, uint64_t offset,
+              uint64_t tag, uint8_t flags = 0) {
+        queue(IORING_OP_READ, file, buffer, size, offset, tag, flags);
+    }
+
+    void write(int file, char const* buffer, size_t size, uint64_t offset,
+               uint64_t tag) {
+        queue(IORING_OP_WRITE, file, const_cast<char*>(buffer), size, offset,
+              tag);
+    }
+
+    // Submits queued requests and waits for a completion, unless one is
+    // already there. Returns the tag and result of the completion.
+    std::pair<uint64_t, int32_t> wait() {
+        unsigned head = *cqHead;
+
+        while (head == std::atomic_ref(*cqTail).load(std::memory_order_acquire))
+            enter(queued, 1, IORING_ENTER_GETEVENTS);
+
+        io_uring_cqe const& cqe = cqes[head & cqMask];
+        std::pair<uint64_t, int32_t> completion{cqe.user_data, cqe.res};
+
+        std::atomic_ref(*cqHead).store(head + 1, std::memory_order_release);
+        return completion;
+    }
+
+    void submit() {
+        if (queued > 0)
+            enter(queued, 0, 0);
+    }
+
+private:
+    int fd;
+    void* sqRing;
+    void* cqRing;
+    size_t sqSize, cqSize, sqesSize;
+    io_uring_sqe* sqes;
+    io_uring_cqe* cqes;
+    unsigned *sqHead, *sqTail, *sqArray, *cqHead, *cqTail;
+    unsigned sqMask, cqMask, sqEntries;
+    unsigned queued = 0;
+
+    void* map(size_t size, uint64_t offset) {
+        void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, offset);
+
+        if (ring == MAP_FAILED)
+            throw std::system_error(errno, std::system_category(), "mmap");
+
+        return ring;
+    }
+
+    void enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        int submitted = syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                                flags, nullptr, 0);
+
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN)
+            throw std::system_error(errno, std::system_category(),
+                                    "io_uring_enter");
+
+        if (submitted > 0)
+            queued -= submitted;
+    }
+
+    void queue(uint8_t opcode, int file, char* buffer, size_t size,
+               uint64_t offset, uint64_t tag, uint8_t flags = 0) {
+        unsigned tail = *sqTail;
+
+        if (tail - std::atomic_ref(*sqHead).load(std::memory_order_acquire)
+            == sqEntries) {
+            submit();
+        }
+
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.flags = flags;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = size;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sqArray[index] = index;
+        std::atomic_ref(*sqTail).store(tail + 1, std::memory_order_release);
+        queued++;
+    }
+};
+
+// Leaks buffer, which the kernel may still access after its ring failed.
+// Destructors do this rather than throw.
+inline void abandon(std::vector<char>& buffer) {
+    new std::vector<char>(std::move(buffer));
+}
+
+inline bool seekable(int fd) {
+    struct stat status;
+
+    return !fstat(fd, &status) && S_ISREG(status.st_mode);
+}
+
+class InputBuffer : public std::streambuf {
+public:
+    explicit InputBuffer(int fd)
+        : fd(fd), ring(2 * READ_DEPTH), regularFile(seekable(fd)) {
+        if (regularFile) {
+            off_t position = lseek(fd, 0, SEEK_CUR);
+            nextOffset = position < 0 ? 0 : position;
+        }
+
+        requestFree();
+    }
+
+    ~InputBuffer() override {
+        // the kernel must not write to the buffers after they are freed
+        try {
+            for (Chunk& chunk : chunks) {
+                while (chunk.state == Chunk::InFlight)
+                    complete(ring.wait());
+            }
+        } catch (std::system_error const&) {
+            for (Chunk& chunk : chunks) {
+                if (chunk.state == Chunk::InFlight)
+                    abandon(chunk.data);
+            }
+        }
+    }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        if (started) {
+            chunks[current].state = Chunk::Free;
+            current = (current + 1) % READ_DEPTH;
+            requestFree();
+        }
+
+        started = true;
+        Chunk& chunk = chunks[current];
+
+        // a read cancelled with a broken chain is requested again once the
+        // rest of the chain is done
+        while (chunk.state == Chunk::InFlight ||
+               (chunk.state == Chunk::Free && !endOfFile)) {
+            complete(ring.wait());
+            requestFree();
+        }
+
+        if (chunk.state == Chunk::Free || chunk.filled == 0)
+            return traits_type::eof();
+
+        setg(chunk.data.data(), chunk.data.data(),
+             chunk.data.data() + chunk.filled);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    struct Chunk {
+        enum State { Free, InFlight, Ready };
+
+        std::vector<char> data = std::vector<char>(BUFFER_SIZE);
+        uint64_t offset = 0;
+        size_t filled = 0;
+        State state = Free;
+    };
+
+    int fd;
+    Ring ring;
+    bool regularFile;
+    // consumed in turn, starting at current; the free ones always follow
+    // those in flight or ready
+    std::array<Chunk, READ_DEPTH> chunks;
+    size_t current = 0;
+    uint64_t nextOffset = 0;
+    bool started = false;
+    bool endOfFile = false;
+
+    // Requests the free chunks in turn. A regular file is read at explicit
+    // offsets, so its reads may complete in any order. Reads of a pipe all
+    // take the current position, so they are linked to run one after the
+    // other; a short read breaks the chain and the kernel cancels the rest.
+    // A new chain waits until the last one is done.
+    void requestFree() {
+        bool inFlight = false;
+        size_t first = READ_DEPTH;
+
+        for (size_t i = 0; i < READ_DEPTH; i++) {
+            Chunk const& chunk = chunks[(current + i) % READ_DEPTH];
+
+            inFlight |= chunk.state == Chunk::InFlight;
+
+            if (chunk.state == Chunk::Free && first == READ_DEPTH)
+                first = i;
+        }
+
+        if (endOfFile || first == READ_DEPTH || (inFlight && !regularFile))
+            return;
+
+        for (size_t i = first; i < READ_DEPTH; i++) {
+            size_t index = (current + i) % READ_DEPTH;
+            Chunk& chunk = chunks[index];
+
+            chunk.filled = 0;
+            chunk.offset = regularFile ? nextOffset : CURRENT_POSITION;
+            nextOffset += BUFFER_SIZE;
+            resume(index, !regularFile && i + 1 < READ_DEPTH);
+        }
+
+        ring.submit();
+    }
+
+    void resume(size_t index, bool linked = false) {
+        Chunk& chunk = chunks[index];
+        uint64_t offset = chunk.offset == CURRENT_POSITION
+                              ? CURRENT_POSITION
+                              : chunk.offset + chunk.filled;
+
+        chunk.state = Chunk::InFlight;
+        ring.read(fd, chunk.data.data() + chunk.filled,
+                  BUFFER_SIZE - chunk.filled, offset, index,
+                  linked ? IOSQE_IO_LINK : 0);
+    }
+
+    void complete(std::pair<uint64_t, int32_t> completion) {
+        auto [index, result] = completion;
+        Chunk& chunk = chunks[index];
+
+        chunk.state = Chunk::Ready;
+
+        if (result == -ECANCELED) {
+            // an earlier read of the chain came up short
+            chunk.state = Chunk::Free;
+        } else if (result == -EINTR || result == -EAGAIN) {
+            resume(index);
+        } else if (result <= 0) {
+            endOfFile = true;
+        } else {
+            chunk.filled += result;
+
+            // a regular file is read in consecutive pieces, so a piece
+            // is only complete once it is full or the file has ended
+            if (regularFile && chunk.filled < BUFFER_SIZE)
+                resume(index);
+        }
+
+        ring.submit();
+    }
+};
+
+class OutputBuffer : public std::streambuf {
+public:
+    explicit OutputBuffer(int fd) : fd(fd), ring(4) {
+        startBuffer();
+    }
+
+    ~OutputBuffer() override {
+        try {
+            finish();
+        } catch (std::system_error const&) {
+            // what is left is lost, but the kernel may still read it
+            if (inFlight)
+                abandon(queued.front());
+        }
+    }
+
+    // Writes out everything and waits until the kernel has taken it.
+    void finish() {
+        sync();
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            queueBuffer();
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+
+        return traits_type::not_eof(c);
+    }
+
+    // Like a flush of the standard buffers, returns once the output is
+    // written, so that it comes before what is written to other files
+    // next (e.g. std::cerr, which flushes std::cout first).
+    int sync() override {
+        if (pptr() > pbase())
+            queueBuffer();
+
+        while (inFlight)
+            complete(ring.wait());
+
+        return 0;
+    }
+
+private:
+    int fd;
+    Ring ring;
+    std::vector<char> filling;
+    // filled buffers in order, the first one is being written
+    std::deque<std::vector<char>> queued;
+    std::vector<std::vector<char>> spare;
+    size_t written = 0;
+    bool inFlight = false;
+
+    void startBuffer() {
+        if (spare.empty()) {
+            filling.resize(BUFFER_SIZE);
+        } else {
+            filling = std::move(spare.back());
+            spare.pop_back();
+        }
+
+        setp(filling.data(), filling.data() + filling.size());
+    }
+
+    void queueBuffer() {
+        filling.resize(pptr() - pbase());
+        queued.push_back(std::move(filling));
+        startBuffer();
+
+        // do not let a slow disk make us hold unbounded output
+        while (queued.size() > MAXIMAL_QUEUED_WRITES)
+            complete(ring.wait());
+
+        writeNext();
+    }
+
+    void writeNext() {
+        if (inFlight || queued.empty())
+            return;
+
+        std::vector<char> const& buffer = queued.front();
+
+        inFlight = true;
+        ring.write(fd, buffer.data() + written, buffer.size() - written,
+                   CURRENT_POSITION, 0);
+        ring.submit();
+    }
+
+    void complete(std::pair<uint64_t, int32_t> completion) {
+        int32_t result = completion.second;
+
+        inFlight = false;
+
+        if (result > 0) {
+            written += result;
+        } else if (result != -EINTR && result != -EAGAIN) {
+            // the output is gone (e.g. a closed pipe), drop what is left
+            written = queued.front().size();
+        }
+
+        if (written == queued.front().size()) {
+            written = 0;
+            queued.front().resize(BUFFER_SIZE);
+            spare.push_back(std::move(queued.front()));
+            queued.pop_front();
+        }
+
+        writeNext();
+    }
+};
+
+}  // namespace uring_streams
+
+#endif  // URING_STREAMS_H